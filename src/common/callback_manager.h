@@ -1,5 +1,9 @@
 #pragma once
 
+#include <cstdio>
+
+#include "common/util.h"
+
 //
 // Generic callback manager
 //
@@ -8,6 +12,14 @@
 // eg: if the callback should be `cb(void* userdata, int my_data)`
 //     define a `CallbackManager<int> int_callbacks;`
 //
+// Some of these sit on _very_ hot paths (eg: the PPU runs a couple on every
+// single dot), so running a manager with nothing registered boils down to a
+// single (well predicted) branch, and registered callbacks are kept in a
+// contiguous array.
+//
+// Builds that never hook into the emulator (eg: the batch env) can define
+// ANESE_NO_CALLBACKS, which compiles run() down to nothing at all.
+//
 
 template <typename ...cb_args>
 class CallbackManager {
@@ -15,44 +27,54 @@ public:
   using cb_t = void(*)(void* userdata, cb_args...);
 
 private:
-  struct cb_node {
-    cb_t  cb = nullptr;
-    void* userdata = nullptr;
-    cb_node* next = nullptr;
-
-    cb_node() = delete;
-    cb_node(cb_t cb, void* userdata)
-    : cb {cb}
-    , userdata {userdata}
-    {}
+  struct cb_entry {
+    cb_t  cb;
+    void* userdata;
   };
 
-  // linked list
-  cb_node* cbs = nullptr;
+  cb_entry* cbs = nullptr;
+  uint len = 0;
+  uint cap = 0;
 
-public:
-  ~CallbackManager() {
-    while (this->cbs) {
-      cb_node* n = this->cbs;
-      this->cbs = cbs->next;
-      delete n;
-    }
+  void run_all(cb_args... args) const {
+    // most recently added callback runs first
+    for (uint i = this->len; i-- > 0;)
+      this->cbs[i].cb(this->cbs[i].userdata, args...);
   }
 
+public:
+  ~CallbackManager() { delete[] this->cbs; }
+  CallbackManager() = default;
+
+  CallbackManager(const CallbackManager&) = delete;
+  CallbackManager& operator=(const CallbackManager&) = delete;
+
   void add_cb(cb_t function, void* userdata) {
-    cb_node* n = new cb_node (function, userdata);
-    if (!this->cbs) this->cbs = n;
-    else {
-      n->next = this->cbs;
-      this->cbs = n;
+#ifdef ANESE_NO_CALLBACKS
+    fprintf(stderr, "[Callbacks] Built with ANESE_NO_CALLBACKS, "
+                    "callbacks will never run!\n");
+#endif
+
+    if (this->len == this->cap) {
+      this->cap = this->cap ? this->cap * 2 : 2;
+      cb_entry* cbs = new cb_entry [this->cap];
+      for (uint i = 0; i < this->len; i++)
+        cbs[i] = this->cbs[i];
+      delete[] this->cbs;
+      this->cbs = cbs;
     }
+
+    this->cbs[this->len++] = { function, userdata };
   }
 
+  bool empty() const { return this->len == 0; }
+
+#ifndef ANESE_NO_CALLBACKS
   void run(cb_args... args) const {
-    cb_node* n = this->cbs;
-    while (n) {
-      n->cb(n->userdata, args...);
-      n = n->next;
-    }
+    if (this->len)
+      this->run_all(args...);
   }
+#else
+  void run(cb_args...) const {}
+#endif
 };
@@ -1,11 +1,17 @@
 #include "serializable.h"
 
-// #define fprintf(...) // disable spam
+// Logs every single field that gets (de)serialized.
+// Super handy for debugging, but _very_ spammy (and slow), so it's opt-in.
+#ifdef SERIAL_DEBUG
+  #define serial_log(...) fprintf(stderr, __VA_ARGS__)
+#else
+  #define serial_log(...)
+#endif
 
 /*----------  Serializable Chunk Implementation  ----------*/
 
 Serializable::Chunk::~Chunk() {
-  delete this->data;
+  delete[] this->data;
   delete this->next;
 }
 
@@ -98,10 +104,17 @@ const Serializable::Chunk* Serializable::Chunk::parse(const u8* data, uint len)
 
 /*--------------------------  De/Serialize Methods  --------------------------*/
 
-static char indent_buf [256] = {0};
-static uint indent_i = 0;
-void indent_add() { indent_buf[indent_i++] = ' ';  }
-void indent_del() { indent_buf[--indent_i] = '\0'; }
+// Only needed for serial_log. Objects get (de)serialized from multiple threads
+// at once (eg: anese_golden), so the indentation is tracked per-thread.
+#ifdef SERIAL_DEBUG
+static thread_local char indent_buf [256] = {0};
+static thread_local uint indent_i = 0;
+static void indent_add() { indent_buf[indent_i++] = ' ';  }
+static void indent_del() { indent_buf[--indent_i] = '\0'; }
+#else
+static void indent_add() {}
+static void indent_del() {}
+#endif
 
 Serializable::Chunk* Serializable::serialize() const {
   indent_add();
@@ -114,7 +127,7 @@ Serializable::Chunk* Serializable::serialize() const {
 
   for (uint i = 0; i < field_data_len; i++) {
     const _field_data& field = field_data[i];
-    fprintf(stderr, "[Serialization][%d] %s%-50s: len %X | ",
+    serial_log("[Serialization][%d] %s%-50s: len %X | ",
       field.type,
       indent_buf,
       field.label,
@@ -125,25 +138,25 @@ Serializable::Chunk* Serializable::serialize() const {
     switch (field.type) {
     case _field_type::SERIAL_INVALID: assert(false); break;
     case _field_type::SERIAL_POD:
-      fprintf(stderr, "0x%08X\n", *((uint*)field.thing));
+      serial_log("0x%08X\n", *((uint*)field.thing));
       next = new Chunk(field.thing, field.len_fixed);
       break;
     case _field_type::SERIAL_ARRAY_VARIABLE:
-      fprintf(stderr, "0x%08X\n", **((uint**)field.thing));
+      serial_log("0x%08X\n", **((uint**)field.thing));
       next = new Chunk(*((void**)field.thing), *field.len_variable);
       break;
     case _field_type::SERIAL_IZABLE:
-      fprintf(stderr, "serializable: \n");
+      serial_log("serializable: \n");
       next = ((Serializable*)field.thing)->serialize();
       assert(next != nullptr);
       break;
     case _field_type::SERIAL_IZABLE_PTR: {
-      fprintf(stderr, "serializable_ptr: ");
+      serial_log("serializable_ptr: ");
       if (!field.thing) {
-        fprintf(stderr, "null\n");
+        serial_log("null\n");
         next = new Chunk(); // nullchunk.
       } else {
-        fprintf(stderr, "recursive\n");
+        serial_log("recursive\n");
         next = ((Serializable*)field.thing)->serialize();
         assert(next != nullptr);
       }
@@ -163,7 +176,7 @@ Serializable::Chunk* Serializable::serialize() const {
     }
   }
   indent_del();
-  delete field_data;
+  delete[] field_data;
   return head;
 }
 
@@ -177,7 +190,7 @@ const Serializable::Chunk* Serializable::deserialize(const Chunk* c) {
 
   for (uint i = 0; i < field_data_len; i++) {
     const _field_data& field = field_data[i];
-    fprintf(stderr, "[DeSerialization][%d] %s%-50s: len %X | ",
+    serial_log("[DeSerialization][%d] %s%-50s: len %X | ",
       field.type,
       indent_buf,
       field.label,
@@ -189,28 +202,28 @@ const Serializable::Chunk* Serializable::deserialize(const Chunk* c) {
     switch (field.type) {
     case _field_type::SERIAL_INVALID: assert(false); break;
     case _field_type::SERIAL_POD:
-      fprintf(stderr, "0x%08X\n", *((uint*)c->data));
+      serial_log("0x%08X\n", *((uint*)c->data));
       memcpy(field.thing, c->data, c->len);
       c = c->next;
       break;
     case _field_type::SERIAL_ARRAY_VARIABLE:
-      fprintf(stderr, "0x%08X\n", *((uint*)c->data));
+      serial_log("0x%08X\n", *((uint*)c->data));
       memcpy(*((void**)field.thing), c->data, c->len);
       c = c->next;
       break;
     case _field_type::SERIAL_IZABLE:
-      fprintf(stderr, "serializable: \n");
+      serial_log("serializable: \n");
       // recursively deserialize the data
       c = ((Serializable*)field.thing)->deserialize(c);
       break;
     case _field_type::SERIAL_IZABLE_PTR: {
-      fprintf(stderr, "serializable_ptr: ");
+      serial_log("serializable_ptr: ");
       if (c->len == 0 && field.thing == nullptr) {
-        fprintf(stderr, "null\n");
+        serial_log("null\n");
         // nullchunk. Ignore this and carry on.
         c = c->next;
       } else {
-        fprintf(stderr, "recursive\n");
+        serial_log("recursive\n");
         // recursively deserialize the data
         c = ((Serializable*)field.thing)->deserialize(c);
       }
@@ -219,6 +232,239 @@ const Serializable::Chunk* Serializable::deserialize(const Chunk* c) {
   }
 
   indent_del();
-  delete field_data;
+  delete[] field_data;
+
+  this->state_loaded();
   return c;
 }
+
+void Serializable::copy_state(const Serializable& other) {
+  const Serializable::_field_data* field_data = nullptr;
+  uint field_data_len = 0;
+  this->_get_serializable_state(field_data, field_data_len);
+
+  const Serializable::_field_data* other_field_data = nullptr;
+  uint other_field_data_len = 0;
+  other._get_serializable_state(other_field_data, other_field_data_len);
+
+  if (field_data_len != other_field_data_len) {
+    fprintf(stderr, "[Serializable] Error: Cannot copy state between objects "
+                    "with different layouts! (%u != %u fields)\n",
+                    field_data_len, other_field_data_len);
+    assert(false);
+  }
+
+  for (uint i = 0; i < field_data_len; i++) {
+    const _field_data& field = field_data[i];
+    const _field_data& other_field = other_field_data[i];
+
+    switch (field.type) {
+    case _field_type::SERIAL_INVALID: assert(false); break;
+    case _field_type::SERIAL_POD:
+      memcpy(field.thing, other_field.thing, field.len_fixed);
+      break;
+    case _field_type::SERIAL_ARRAY_VARIABLE:
+      assert(*field.len_variable == *other_field.len_variable);
+      memcpy(
+        *((void**)field.thing),
+        *((void**)other_field.thing),
+        *other_field.len_variable
+      );
+      break;
+    case _field_type::SERIAL_IZABLE:
+      ((Serializable*)field.thing)->copy_state(
+        *((const Serializable*)other_field.thing)
+      );
+      break;
+    case _field_type::SERIAL_IZABLE_PTR: {
+      if (field.thing == nullptr && other_field.thing == nullptr)
+        break;
+      assert(field.thing && other_field.thing);
+      ((Serializable*)field.thing)->copy_state(
+        *((const Serializable*)other_field.thing)
+      );
+    } break;
+    }
+  }
+
+  delete[] field_data;
+  delete[] other_field_data;
+
+  this->state_loaded();
+}
+
+/*--------------------------------  Layout  ----------------------------------*/
+
+Serializable::Layout::Layout(Serializable& root) {
+  // first pass counts spans / objects, second pass fills them in
+  this->walk(root, false);
+
+  this->spans   = new Span          [this->spans_len];
+  this->objects = new Serializable* [this->objects_len];
+  this->spans_len = this->objects_len = this->size = 0;
+
+  this->walk(root, true);
+
+  for (uint i = 0; i < this->spans_len; i++)
+    if (this->spans[i].dirty)
+      this->spans[i].history = new DirtyPages [HISTORY];
+
+  memset(this->syncs, 0, sizeof this->syncs);
+}
+
+Serializable::Layout::~Layout() {
+  for (uint i = 0; i < this->spans_len; i++)
+    delete[] this->spans[i].history;
+  delete[] this->spans;
+  delete[] this->objects;
+}
+
+void Serializable::Layout::walk(Serializable& obj, bool fill) {
+  const Serializable::_field_data* field_data = nullptr;
+  uint field_data_len = 0;
+  obj._get_serializable_state(field_data, field_data_len);
+
+  for (uint i = 0; i < field_data_len; i++) {
+    const _field_data& field = field_data[i];
+
+    u8*  ptr = nullptr;
+    uint len = 0;
+    DirtyPages* dirty = nullptr;
+
+    switch (field.type) {
+    case _field_type::SERIAL_INVALID: assert(false); break;
+    case _field_type::SERIAL_POD:
+      ptr = (u8*)field.thing;
+      len = field.len_fixed;
+      break;
+    case _field_type::SERIAL_ARRAY_VARIABLE:
+      ptr = *((u8**)field.thing);
+      len = *field.len_variable;
+      dirty = field.dirty;
+      break;
+    case _field_type::SERIAL_IZABLE:
+      this->walk(*((Serializable*)field.thing), fill);
+      break;
+    case _field_type::SERIAL_IZABLE_PTR:
+      if (field.thing)
+        this->walk(*((Serializable*)field.thing), fill);
+      break;
+    }
+
+    if (len == 0) continue;
+
+    this->size += len;
+
+    if (!fill) {
+      this->spans_len++; // (upper bound, since spans might get merged)
+      continue;
+    }
+
+    // merge fields that are adjacent in memory into a single span
+    // (as long as neither of them are page-tracked)
+    Span* last = this->spans_len ? &this->spans[this->spans_len - 1] : nullptr;
+    if (last && !last->dirty && !dirty && last->ptr + last->len == ptr)
+      last->len += len;
+    else
+      this->spans[this->spans_len++] = { ptr, len, dirty, nullptr };
+  }
+
+  delete[] field_data;
+
+  if (fill) this->objects[this->objects_len] = &obj;
+  this->objects_len++;
+}
+
+// Files away the pages dirtied since the last sync (under its generation), and
+// starts a new generation that's in sync with buf
+u32 Serializable::Layout::record_sync(const u8* buf) {
+  for (uint i = 0; i < this->spans_len; i++) {
+    const Span& span = this->spans[i];
+    if (!span.dirty) continue;
+    span.history[this->generation % HISTORY] = *span.dirty;
+    span.dirty->clear();
+  }
+
+  if (++this->generation == 0) this->generation = 1; // 0 is never valid
+  this->syncs[this->generation % HISTORY] = { this->generation, buf };
+  return this->generation;
+}
+
+u32 Serializable::Layout::save(u8* buf) {
+  u8* p = buf;
+  for (uint i = 0; i < this->spans_len; i++) {
+    memcpy(p, this->spans[i].ptr, this->spans[i].len);
+    p += this->spans[i].len;
+  }
+
+  return this->record_sync(buf);
+}
+
+uint Serializable::Layout::save_incremental(u8* buf, u32& sync) {
+  const Sync& last = this->syncs[sync % HISTORY];
+  const bool in_sync = sync != 0
+    && this->tracking_since != 0
+    && this->generation - sync < HISTORY
+    && this->generation - sync <= this->generation - this->tracking_since
+    && last.generation == sync && last.buf == buf;
+
+  if (!in_sync) {
+    // dirty pages only get tracked once someone actually needs them
+    if (this->tracking_since == 0) {
+      for (uint i = 0; i < this->spans_len; i++)
+        if (this->spans[i].dirty)
+          this->spans[i].dirty->tracking = true;
+    }
+    sync = this->save(buf);
+    if (this->tracking_since == 0) this->tracking_since = sync;
+    return this->size;
+  }
+
+  uint copied = 0;
+  u8* p = buf;
+  for (uint i = 0; i < this->spans_len; i++) {
+    const Span& span = this->spans[i];
+
+    if (!span.dirty) {
+      memcpy(p, span.ptr, span.len);
+      copied += span.len;
+    } else {
+      // everything written to since buf was synced
+      DirtyPages pages = *span.dirty;
+      for (u32 gen = sync; gen != this->generation; gen++)
+        for (uint j = 0; j < 4; j++)
+          pages.bits[j] |= span.history[gen % HISTORY].bits[j];
+
+      for (uint page = 0; page * 256 < span.len; page++) {
+        if (!pages.is_dirty(page)) continue;
+        const uint left = span.len - page * 256;
+        const uint len = left < 256 ? left : 256;
+        memcpy(p + page * 256, span.ptr + page * 256, len);
+        copied += len;
+      }
+    }
+
+    p += span.len;
+  }
+
+  sync = this->record_sync(buf);
+  return copied;
+}
+
+u32 Serializable::Layout::load(const u8* buf) {
+  const u8* p = buf;
+  for (uint i = 0; i < this->spans_len; i++) {
+    memcpy(this->spans[i].ptr, p, this->spans[i].len);
+    p += this->spans[i].len;
+  }
+  for (uint i = 0; i < this->objects_len; i++)
+    this->objects[i]->state_loaded();
+
+  // the object now matches buf exactly (even if state_loaded marked stuff),
+  // but every other buffer might differ from it anywhere
+  for (uint i = 0; i < this->spans_len; i++)
+    if (this->spans[i].dirty)
+      this->spans[i].dirty->mark_all();
+
+  return this->record_sync(buf);
+}
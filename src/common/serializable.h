@@ -99,6 +99,17 @@
 //   you add the SERIALIZE_PARENT(BaseClass) macro before SERIALIZE_START.
 //   This tells Serializable to also serialize whatever state the parent had
 //     - _Caveat:_ There is no support for multiple inheritance at the moment
+// - copy_state(other) copies fields straight from another instance of the same
+//   type, without going through Chunks at all. It's equivalent to (but a whole
+//   lot faster than) calling deserialize(other.serialize()).
+// - If a class needs to fix itself up after its state is loaded (eg: rebuild
+//   some derived, non-serialized state), override state_loaded(). It's called
+//   after deserialize(), copy_state(), and Layout::load().
+// - Layout flattens an object's (recursive) fields into one fixed-size buffer,
+//   which makes for _very_ fast savestates (see below).
+// - Variable-length arrays that keep track of which 256 byte pages have been
+//   written to (see DirtyPages) can use SERIALIZE_ARRAY_VARIABLE_DIRTY, which
+//   lets Layout::save_incremental skip copying the pages that haven't changed.
 // - Since everything is just regular 'ol C++ under the hood, you can implement
 //   custom serialization routines (outside of the predefined macros). When
 //   doing so, express intent by wrapping the custom implementation in a
@@ -134,9 +145,107 @@ public:
   virtual Chunk* serialize() const;
   // Updates class's data fields with chunk data, and returns new head-chunk
   virtual const Chunk* deserialize(const Chunk* c);
+  // Updates class's data fields with those of another instance of the class
+  virtual void copy_state(const Serializable& other);
+
+  // Per-256-byte-page dirty bits, for arrays up to 64K long
+  // (see SERIALIZE_ARRAY_VARIABLE_DIRTY)
+  // Marking is a no-op until a Layout starts tracking the array (ie: the first
+  // time save_incremental is used), so nothing pays for it otherwise.
+  struct DirtyPages {
+    u64 bits [4] = {0};
+    bool tracking = false;
+
+    void mark(u16 addr) {
+      if (this->tracking)
+        this->bits[addr >> 14] |= u64(1) << ((addr >> 8) % 64);
+    }
+    bool is_dirty(uint page) const { return (this->bits[page / 64] >> (page % 64)) & 1; }
+    void mark_all() { memset(this->bits, 0xFF, sizeof this->bits); }
+    void clear()    { memset(this->bits, 0x00, sizeof this->bits); }
+  };
+
+  // Flat state layout
+  // Walks an object's field list (recursively) once up-front, and records where
+  // each field lives in memory, and where it goes in a single flat buffer.
+  // Saving / loading state is then just a linear run of memcpys over that
+  // buffer (with fields that are adjacent in memory merged together), without
+  // any allocations or Chunk lists involved.
+  //
+  // Incremental saves: every save / load hands back a sync token, which names
+  // that exact sync between the object and the buffer. Passing a buffer's
+  // token back to save_incremental means only the pages of
+  // SERIALIZE_ARRAY_VARIABLE_DIRTY arrays that were written to since then have
+  // to be copied (the rest of the state is still copied in full, but it's
+  // tiny). The Layout remembers the dirty pages of the last HISTORY syncs, so
+  // a ring of up to HISTORY buffers (eg: rewind / rollback slots), each with
+  // its own token, stays incremental. Any other token (eg: 0, for a fresh
+  // buffer, or one that's too old) just does a full save, so reallocating a
+  // buffer is safe as long as its token is reset.
+  //
+  // NOTE: A Layout holds raw pointers into the object (and the objects it
+  // holds), so it must be rebuilt whenever the structure changes (eg: when a
+  // SERIALIZE_SERIALIZABLE_PTR starts pointing somewhere else)
+  // NOTE: Layout clears the dirty bits of the arrays it covers, so there should
+  // only be one Layout per object.
+  class Layout {
+  public:
+    // How many syncs back a token stays good for save_incremental
+    static constexpr uint HISTORY = 16;
+
+  private:
+    struct Span {
+      u8*  ptr;
+      uint len;
+      DirtyPages* dirty;   // nullptr if the span isn't page-tracked
+      DirtyPages* history; // pages written between sync N and N + 1, at N % HISTORY
+    };
+    Span* spans = nullptr;
+    uint  spans_len = 0;
+
+    // Every object in the layout (in the same order deserialize() would finish
+    // with them), for running state_loaded()
+    Serializable** objects = nullptr;
+    uint           objects_len = 0;
+
+    uint size = 0; // size of the flat buffer
+
+    // The buffer each of the last HISTORY syncs went to / came from
+    struct Sync {
+      u32       generation;
+      const u8* buf;
+    } syncs [HISTORY];
+
+    u32 generation = 0;     // bumped on every save / load (0 = never)
+    u32 tracking_since = 0; // first sync with dirty pages tracked (0 = none yet)
+
+    void walk(Serializable& obj, bool fill);
+    u32  record_sync(const u8* buf);
+
+  public:
+    ~Layout();
+    Layout() = delete;
+    Layout(const Layout&) = delete;
+    Layout(Serializable& root);
+
+    uint state_size() const { return this->size; }
+
+    // Both return a sync token for buf (see save_incremental)
+    u32 save(u8* buf);       // buf must hold state_size() bytes
+    u32 load(const u8* buf); // also runs state_loaded() on everything
+
+    // Same as save, but if `sync` is the token from buf's last save / load (one
+    // of the last HISTORY syncs, and buf can't have been touched since), only
+    // the pages dirtied since then are copied. `sync` is updated to buf's new
+    // token. Returns the # of bytes copied.
+    uint save_incremental(u8* buf, u32& sync);
+  };
 
 /*------------------------------  Macro Support  -----------------------------*/
 protected:
+  // Called after the object's state has been loaded
+  virtual void state_loaded() {}
+
   enum _field_type {
     SERIAL_INVALID = 0,
     SERIAL_POD,
@@ -153,6 +262,8 @@ protected:
     // only one of the following are used
     uint len_fixed;
     uint* len_variable;
+    // only for SERIAL_ARRAY_VARIABLE (optional)
+    DirtyPages* dirty;
   };
 
   // This gets overridden through macros
@@ -171,7 +282,7 @@ protected:
     static const _field_data nothing [1] = {{
       "<nothing>", "<nothing>",
       _field_type::SERIAL_POD, &dump,
-      sizeof dump, nullptr
+      sizeof dump, nullptr, nullptr
     }};
 
     data = nothing;
@@ -245,7 +356,7 @@ protected:
     chunk_label, strrchr(__FILE__ ": " #thing, slash) + 1,                     \
     Serializable::_field_type::SERIAL_POD,                                     \
     (void*)&(thing),                                                           \
-    sizeof(thing), 0                                                           \
+    sizeof(thing), 0, nullptr                                                  \
   };
 
 #define SERIALIZE_ARRAY_VARIABLE(thing, len)                                   \
@@ -253,7 +364,15 @@ protected:
     chunk_label, strrchr(__FILE__ ": " #thing, slash) + 1,                     \
     Serializable::_field_type::SERIAL_ARRAY_VARIABLE,                          \
     (void*)&(thing),                                                           \
-    0, (uint*)&len                                                             \
+    0, (uint*)&len, nullptr                                                    \
+  };
+
+#define SERIALIZE_ARRAY_VARIABLE_DIRTY(thing, len, dirty_pages)                \
+  new_state[i++] = {                                                           \
+    chunk_label, strrchr(__FILE__ ": " #thing, slash) + 1,                     \
+    Serializable::_field_type::SERIAL_ARRAY_VARIABLE,                          \
+    (void*)&(thing),                                                           \
+    0, (uint*)&len, (Serializable::DirtyPages*)&(dirty_pages)                  \
   };
 
 #define SERIALIZE_SERIALIZABLE(item)                                           \
@@ -261,7 +380,7 @@ protected:
     chunk_label, strrchr(__FILE__ ": " #item, slash) + 1,                      \
     Serializable::_field_type::SERIAL_IZABLE,                                  \
     (void*)static_cast<const Serializable*>(&(item)),                          \
-    0, 0                                                                       \
+    0, 0, nullptr                                                              \
   };                                                                           \
   if (new_state[i-1].thing == nullptr)                                         \
     fprintf(stderr, "[Serializable][%s] Warning: could not cast `" #item       \
@@ -272,7 +391,7 @@ protected:
     chunk_label, strrchr(__FILE__ ": " #thingptr, slash) + 1,                  \
     Serializable::_field_type::SERIAL_IZABLE_PTR,                              \
     (void*)static_cast<const Serializable*>(thingptr),                         \
-    0, 0                                                                       \
+    0, 0, nullptr                                                              \
   };
 
 #define SERIALIZE_CUSTOM() // doesn't do anything except express intent
@@ -0,0 +1,125 @@
+#include "trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+
+namespace Trace {
+
+bool enabled = false;
+
+namespace {
+
+struct Event {
+  const char* name;
+  u64 ts; // us since the tracer was enabled
+  bool begin;
+};
+
+struct Ring {
+  static constexpr uint SIZE = 1 << 16;
+  Event events [SIZE];
+  u64 len = 0; // total # of events recorded (index = len % SIZE)
+  const char* name = nullptr;
+};
+
+// Rings are handed out to threads on first use, and never freed
+constexpr uint MAX_THREADS = 64;
+Ring* rings [MAX_THREADS];
+std::atomic<uint> rings_len { 0 };
+
+thread_local Ring* ring = nullptr;
+thread_local bool  ring_failed = false; // ran out of rings (only warn once)
+
+std::chrono::steady_clock::time_point start;
+
+Ring* get_ring() {
+  if (!ring) {
+    if (ring_failed) return nullptr;
+    const uint i = rings_len++;
+    if (i >= MAX_THREADS) {
+      fprintf(stderr, "[Trace] Too many threads! Not tracing this one.\n");
+      ring_failed = true;
+      return nullptr;
+    }
+    ring = rings[i] = new Ring ();
+  }
+  return ring;
+}
+
+void record(const char* name, bool begin) {
+  Ring* r = get_ring();
+  if (!r) return;
+
+  const u64 ts = std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now() - start
+  ).count();
+
+  r->events[r->len % Ring::SIZE] = { name, ts, begin };
+  r->len++;
+}
+
+} // namespace
+
+void enable() {
+  start = std::chrono::steady_clock::now();
+  enabled = true;
+}
+
+void thread_name(const char* name) {
+  if (!enabled) return;
+  if (Ring* r = get_ring())
+    r->name = name;
+}
+
+void begin(const char* name) { record(name, true);  }
+void end  (const char* name) { record(name, false); }
+
+bool write(const char* path) {
+  FILE* f = fopen(path, "w");
+  if (!f) {
+    fprintf(stderr, "[Trace] Could not open '%s' for writing!\n", path);
+    return false;
+  }
+
+  fprintf(f, "{\"traceEvents\":[\n");
+  bool first = true;
+
+  uint len = rings_len;
+  if (len > MAX_THREADS) len = MAX_THREADS;
+  for (uint tid = 0; tid < len; tid++) {
+    const Ring& r = *rings[tid];
+
+    if (r.name) {
+      fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                 "\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+        first ? "" : ",\n", tid, r.name);
+      first = false;
+    }
+
+    // If the ring wrapped around, the oldest events are gone, so ends that
+    // are missing their begins are dropped.
+    const u64 oldest = r.len > Ring::SIZE ? r.len - Ring::SIZE : 0;
+    uint depth = 0;
+    for (u64 i = oldest; i < r.len; i++) {
+      const Event& e = r.events[i % Ring::SIZE];
+      if (e.begin) depth++;
+      else if (depth == 0) continue;
+      else depth--;
+
+      fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llu,"
+                 "\"pid\":1,\"tid\":%u}",
+        first ? "" : ",\n", e.name, e.begin ? 'B' : 'E',
+        (unsigned long long)e.ts, tid);
+      first = false;
+    }
+  }
+
+  fprintf(f, "\n]}\n");
+  fclose(f);
+
+  fprintf(stderr, "[Trace] Wrote trace to '%s'\n", path);
+  return true;
+}
+
+} // namespace Trace
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "common/util.h"
+
+//
+// Timeline tracer
+//
+// Records begin / end events (with microsecond timestamps), and dumps them in
+// the Chrome trace event format, which can be opened in chrome://tracing or
+// https://ui.perfetto.dev
+//
+// eg: void Foo::bar() {
+//       TRACE_SCOPE("Foo::bar");
+//       ...
+//     }
+//
+// Every thread records into its own fixed-size ring buffer (so recording is
+// lock-free, and the oldest events get overwritten on long runs).
+// While tracing is disabled (the default), a TRACE_SCOPE is a single branch.
+//
+
+namespace Trace {
+  extern bool enabled;
+
+  void enable();
+
+  // Names the calling thread in the trace
+  void thread_name(const char* name);
+
+  // `name` must be a string literal (only the pointer is recorded)
+  void begin(const char* name);
+  void end(const char* name);
+
+  // Writes every thread's events to a Chrome trace JSON file.
+  // Threads should be done recording by the time this is called.
+  bool write(const char* path);
+
+  class Scope final {
+  private:
+    const char* name;
+    bool active;
+  public:
+    Scope(const char* name) : name(name), active(Trace::enabled) {
+      if (this->active) Trace::begin(this->name);
+    }
+    ~Scope() {
+      if (this->active) Trace::end(this->name);
+    }
+  };
+}
+
+#define TRACE_SCOPE_CONCAT2(a, b) a##b
+#define TRACE_SCOPE_CONCAT(a, b) TRACE_SCOPE_CONCAT2(a, b)
+#define TRACE_SCOPE(name) \
+  Trace::Scope TRACE_SCOPE_CONCAT(_trace_scope_, __LINE__) (name)
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 
 /* Type Aliases */
@@ -31,3 +32,14 @@ template <typename T, typename T2>
 constexpr inline bool in_range(T x, T2 min, T2 max) { return x >= T(min) && x <= T(max); }
 template <typename T, typename T2>
 constexpr inline bool in_range(T x, T2 val) { return x == val; }
+
+// 64-bit FNV-1a hash (fast, but not cryptographic)
+inline u64 fnv1a(const void* data, size_t len) {
+  u64 hash = 0xCBF29CE484222325;
+  const u8* p = (const u8*)data;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= p[i];
+    hash *= 0x100000001B3;
+  }
+  return hash;
+}
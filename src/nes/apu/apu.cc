@@ -53,6 +53,7 @@ static constexpr uint DMC_PERIOD_TABLE [] = {
 
 APU::~APU() {
   for (FirstOrderFilter* filter : this->filters) delete filter;
+  delete[] this->audiobuff.data;
 }
 
 APU::APU(const NES_Params& params, Memory& mem, InterruptLines& interrupt)
@@ -63,6 +64,14 @@ APU::APU(const NES_Params& params, Memory& mem, InterruptLines& interrupt)
   this->chan.pulse2.isPulse2 = true;
   this->power_cycle();
 
+  // Compact instances don't output any audio
+  if (params.compact) {
+    for (FirstOrderFilter*& filter : this->filters) filter = nullptr;
+    return;
+  }
+
+  this->audiobuff.data = new float [4096]();
+
   // Setup filters
   this->filters[0] = new HiPassFilter (90,    params.apu_sample_rate);
   this->filters[1] = new HiPassFilter (440,   params.apu_sample_rate);
@@ -72,6 +81,7 @@ APU::APU(const NES_Params& params, Memory& mem, InterruptLines& interrupt)
 // https://wiki.nesdev.com/w/index.php/CPU_power_up_state
 void APU::power_cycle() {
   memset((char*)&this->chan, 0, sizeof this->chan);
+  this->frame_counter.val = 0x00; // $4017 = $00 at power-up
 
   // https://wiki.nesdev.com/w/index.php/APU_Noise
   this->chan.noise.sr = 1;
@@ -541,6 +551,7 @@ void APU::cycle() {
   }
 
   // Sample APU
+  if (!this->audiobuff.data || this->muted) return;
   if (this->cycles % (this->clock_rate / this->sample_rate) == 0) {
     // Get the sample from the mixer
     float sample = this->mixer.sample(
@@ -556,6 +567,7 @@ void APU::cycle() {
       sample = filter->process(sample);
 
     // Send it off the the audio-buffer!
+    this->_stats.samples++;
     audiobuff.data[audiobuff.i] = sample;
     if (audiobuff.i < 4095) audiobuff.i++;
   }
@@ -196,17 +196,18 @@ private:
 
   /*----------  Emulation Vars  ----------*/
 
-  FirstOrderFilter* filters [3]; // Hi/Lo pass filter chain
+  FirstOrderFilter* filters [3]; // Hi/Lo pass filter chain (unused in compact mode)
 
   uint cycles;   // Total Cycles elapsed
   uint seq_step; // Frame Sequence Step
 
   struct {
     uint i = 0;
-    float data [4096] = {0};
+    float* data = nullptr; // 4096 samples (nullptr in compact mode)
   } audiobuff;
 
   uint clock_rate = 1789773; // changes when speeding up / slowing down NES
+  bool muted = false;        // skip sampling (and filtering) entirely
 
   SERIALIZE_START(4, "APU")
     SERIALIZE_POD(chan)
@@ -257,4 +258,12 @@ public:
 
   void getAudiobuff(float** samples, uint* len);
   void set_speed(float speed);
+  void set_muted(bool muted) { this->muted = muted; }
+
+  /*---------------  Debugging / Instrumentation  --------------*/
+
+  // see NES_Stats
+  struct {
+    u64 samples = 0;
+  } _stats;
 };
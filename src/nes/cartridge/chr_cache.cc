@@ -0,0 +1,127 @@
+#include "chr_cache.h"
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+// Each 16 byte tile decodes into 8 rows of 8 pixels, twice (flipped + not)
+static constexpr uint TILE_LEN = 2 * 8 * 8;
+
+CHR_Cache::CHR_Cache(Memory* const* bank, uint len, uint size, bool is_RAM)
+: bank(bank)
+, len(len)
+, size(size)
+, is_RAM(is_RAM)
+{
+  memset(this->window, 0, sizeof this->window);
+
+  this->tiles = new u8*   [len]();
+  this->valid = new bool* [len]();
+  this->owns_tiles = true;
+}
+
+CHR_Cache::~CHR_Cache() {
+  this->free_tiles();
+}
+
+void CHR_Cache::free_tiles() {
+  if (!this->owns_tiles) return;
+
+  for (uint i = 0; i < this->len; i++) {
+    delete[] this->tiles[i];
+    delete[] this->valid[i];
+  }
+  delete[] this->tiles;
+  delete[] this->valid;
+}
+
+bool CHR_Cache::map(u16 addr, uint bank) {
+  assert(addr < 0x2000 && addr % 0x400 == 0);
+
+  bank %= this->len;
+  bool changed = false;
+  for (uint offset = 0; offset < this->size; offset += 0x400) {
+    const uint w = (addr + offset) / 0x400;
+    if (w >= 8) break;
+    changed |= !this->window[w].mapped
+            || this->window[w].bank   != bank
+            || this->window[w].offset != offset;
+    this->window[w].mapped = true;
+    this->window[w].bank   = bank;
+    this->window[w].offset = offset;
+  }
+  return changed;
+}
+
+void CHR_Cache::invalidate(u16 addr) {
+  if (!this->is_RAM) return;
+
+  const auto& w = this->window[(addr % 0x2000) / 0x400];
+  if (!w.mapped || !this->valid[w.bank]) return;
+
+  this->valid[w.bank][(w.offset + addr % 0x400) / 16] = false;
+}
+
+void CHR_Cache::invalidate_all() {
+  // CHR ROM tiles never go stale (and might be shared, see share_rom)
+  if (!this->is_RAM) return;
+
+  for (uint i = 0; i < this->len; i++)
+    if (this->valid[i])
+      memset(this->valid[i], 0, this->size / 16);
+}
+
+void CHR_Cache::decode(uint bank, uint tile) {
+  if (!this->tiles[bank]) {
+    this->tiles[bank] = new u8   [(this->size / 16) * TILE_LEN];
+    this->valid[bank] = new bool [(this->size / 16)]();
+  }
+
+  const Memory& mem = *this->bank[bank];
+  u8* px = this->tiles[bank] + tile * TILE_LEN;
+
+  for (uint row = 0; row < 8; row++) {
+    const u8 lo_bp = mem.peek(tile * 16 + row + 0);
+    const u8 hi_bp = mem.peek(tile * 16 + row + 8);
+
+    for (uint col = 0; col < 8; col++) {
+      const u8 pixel_type = (nth_bit(lo_bp, 7 - col) << 0)
+                          | (nth_bit(hi_bp, 7 - col) << 1);
+      px[0 * 64 + row * 8 + col    ] = pixel_type;
+      px[1 * 64 + row * 8 + 7 - col] = pixel_type;
+    }
+  }
+
+  this->valid[bank][tile] = true;
+}
+
+const u8* CHR_Cache::row(u16 addr, bool flip_h) {
+  static const u8 blank [8] = {0};
+
+  const auto& w = this->window[(addr % 0x2000) / 0x400];
+  if (!w.mapped) return blank;
+
+  const uint tile = (w.offset + addr % 0x400) / 16;
+  if (!this->valid[w.bank] || !this->valid[w.bank][tile])
+    this->decode(w.bank, tile);
+
+  return this->tiles[w.bank]
+    + tile * TILE_LEN
+    + flip_h * 64
+    + (addr % 8) * 8;
+}
+
+void CHR_Cache::share_rom(CHR_Cache& other) {
+  assert(!this->is_RAM && !other.is_RAM);
+  assert(this->len == other.len && this->size == other.size);
+
+  for (uint bank = 0; bank < other.len; bank++)
+    for (uint tile = 0; tile < other.size / 16; tile++)
+      if (!other.valid[bank] || !other.valid[bank][tile])
+        other.decode(bank, tile);
+
+  this->free_tiles();
+  this->tiles = other.tiles;
+  this->valid = other.valid;
+  this->owns_tiles = false;
+}
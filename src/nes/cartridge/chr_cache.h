@@ -0,0 +1,64 @@
+#pragma once
+
+#include "common/util.h"
+#include "nes/interfaces/memory.h"
+
+// Pre-decoded CHR tile cache
+//
+// CHR data is stored as two bitplanes per tile, which means that getting at a
+// single pixel involves two memory accesses and a bunch of bit-twiddling.
+// This cache holds every tile row pre-decoded into 8 pixel values (0 - 3),
+// both as-is, and flipped horizontally, so that the PPU and the debug views
+// can grab whole rows at a time.
+//
+// Tiles are keyed by the CHR bank they live in, _not_ the PPU address they
+// happen to be mapped at. That way, bank switches only have to update the
+// 1K window -> bank table, and decoded tiles stay valid across bank switches.
+// The only thing that invalidates decoded tiles is writing to CHR RAM.
+class CHR_Cache final {
+private:
+  Memory* const* const bank; // CHR banks (owned by the Mapper)
+  const uint len;            // # of CHR banks
+  const uint size;           // CHR bank size (in bytes)
+  const bool is_RAM;
+
+  // 0x0000 ... 0x1FFF, split into 1K windows (the smallest bank size)
+  struct {
+    bool mapped;
+    uint bank;
+    uint offset; // offset of the window into the bank
+  } window [8];
+
+  // Decoded tiles, lazily allocated per-bank
+  // tiles[bank][tile][flip_h][row][col]
+  u8**   tiles;
+  bool** valid;
+  bool   owns_tiles; // false when using another cache's tiles (see share_rom)
+
+  void decode(uint bank, uint tile);
+  void free_tiles();
+
+public:
+  ~CHR_Cache();
+  CHR_Cache() = delete;
+  CHR_Cache(const CHR_Cache&) = delete;
+  CHR_Cache(Memory* const* bank, uint len, uint size, bool is_RAM);
+
+  // Maps the given bank at PPU addr.
+  // Returns true if that changed what was mapped there.
+  bool map(u16 addr, uint bank);
+
+  void invalidate(u16 addr); // Should be called whenever CHR is written to
+  void invalidate_all();
+
+  // Returns the 8 pixels of the tile row at PPU addr (i.e: the address of the
+  // row's lo bitplane byte), from left to right.
+  const u8* row(u16 addr, bool flip_h);
+
+  // CHR ROM never changes, so caches of the same CHR ROM can all share a
+  // single set of decoded tiles.
+  // Decodes every one of other's tiles up-front (so that they are never written
+  // to again), and switches this cache over to using them.
+  // `other` must outlive this cache.
+  void share_rom(CHR_Cache& other);
+};
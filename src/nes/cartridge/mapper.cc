@@ -1,9 +1,12 @@
 #include "mapper.h"
 
+#include <cassert>
+
 /*--------------------------------  Helpers  ---------------------------------*/
 
 void Mapper::init_prg_banks(const ROM_File& rom_file, const u16 size) {
   this->banks.prg.len = rom_file.rom.prg.len / size;
+  this->banks.prg.size = size;
   this->banks.prg.bank = new ROM* [this->banks.prg.len];
 
   fprintf(stderr, "[Mapper] # %2uK PRG ROM Banks: %u\n",
@@ -29,11 +32,22 @@ void Mapper::init_chr_banks(const ROM_File& rom_file, const u16 size) {
   fprintf(stderr, "[Mapper] # %2uK CHR Banks: %u\n",
     size / 1024, this->banks.chr.len);
 
+  if (this->banks.chr.is_RAM)
+    this->banks.chr.ram = new u8 [this->banks.chr.len * size];
+
   const u8* p = rom_file.rom.chr.data;
-  for (uint i = 0; i < this->banks.chr.len; i++, p += size)
+  u8* ram = this->banks.chr.ram;
+  for (uint i = 0; i < this->banks.chr.len; i++, p += size, ram += size)
     this->banks.chr.bank[i] = this->banks.chr.is_RAM
-      ? (Memory*) new RAM (size,    "Mapper CHR RAM")
-      : (Memory*) new ROM (size, p, "Mapper CHR ROM");
+      ? (Memory*) new RAM (size, ram, "Mapper CHR RAM")
+      : (Memory*) new ROM (size, p,   "Mapper CHR ROM");
+
+  this->chr_cache = new CHR_Cache (
+    this->banks.chr.bank,
+    this->banks.chr.len,
+    size,
+    this->banks.chr.is_RAM
+  );
 }
 
 /*------------------  Common Mapper Functions / Services  --------------------*/
@@ -57,6 +71,30 @@ Memory& Mapper::get_chr_bank(uint bank) const {
   return *this->banks.chr.bank[bank % this->banks.chr.len];
 }
 
+// Mappers tend to call update_banks() on every register write, so only count
+// the bank switches that actually change what's mapped.
+Memory& Mapper::map_chr_bank(u16 addr, uint bank) {
+  if (this->chr_cache->map(addr, bank))
+    this->_stats.bank_switches++;
+  return this->get_chr_bank(bank);
+}
+
+ROM& Mapper::map_prg_bank(u16 addr, uint bank) {
+  assert(addr >= 0x8000 && addr % 0x2000 == 0);
+
+  ROM& rom = this->get_prg_bank(bank);
+  bool changed = false;
+  for (uint offset = 0; offset < this->banks.prg.size; offset += 0x2000) {
+    const uint page = (addr - 0x8000 + offset) / 0x2000;
+    if (page >= 4) break;
+    changed |= this->prg_page[page] != rom.data() + offset;
+    this->prg_page[page] = rom.data() + offset;
+  }
+  if (changed)
+    this->_stats.bank_switches++;
+  return rom;
+}
+
 uint Mapper::get_prg_bank_len() const {
   return this->banks.prg.len;
 }
@@ -75,6 +113,9 @@ Mapper::~Mapper() {
   for (uint i = 0; i < this->banks.chr.len; i++)
     delete this->banks.chr.bank[i];
   delete[] this->banks.chr.bank;
+  delete[] this->banks.chr.ram;
+
+  delete this->chr_cache;
 }
 
 Mapper::Mapper(
@@ -84,11 +125,20 @@ Mapper::Mapper(
 )
 : name(name)
 , number(number)
+, rom_file(rom_file)
 {
   this->init_prg_banks(rom_file, prg_bank_size);
   this->init_chr_banks(rom_file, chr_bank_size);
 }
 
+Mapper* Mapper::clone() const {
+  Mapper* mapper = Mapper::Factory(&this->rom_file);
+  if (!this->banks.chr.is_RAM)
+    mapper->chr_cache->share_rom(*this->chr_cache);
+  mapper->copy_state(*this);
+  return mapper;
+}
+
 /*---------------------------------  Factory  --------------------------------*/
 
 #include "mappers/mapper_000.h"
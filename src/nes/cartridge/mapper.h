@@ -7,6 +7,8 @@
 #include "nes/interfaces/mirroring.h"
 #include "rom_file.h"
 
+#include "chr_cache.h"
+
 #include "nes/wiring/interrupt_lines.h"
 
 #include "common/callback_manager.h"
@@ -32,6 +34,9 @@ private:
   const char* name;
   const uint  number;
 
+  // ROM_File the mapper was constructed from (owned by the Cartridge)
+  const ROM_File& rom_file;
+
   // Wiring
   InterruptLines* interrupt_line = nullptr;
 
@@ -39,6 +44,7 @@ private:
   struct {
     struct {
       uint  len;
+      uint  size;
       ROM** bank;
     } prg;
 
@@ -46,9 +52,16 @@ private:
       bool is_RAM = false;
       uint len;
       Memory** bank;
+      u8* ram = nullptr; // contiguous backing memory for all CHR RAM banks
     } chr;
   } banks;
 
+  // Pre-decoded CHR tiles
+  CHR_Cache* chr_cache;
+
+  // Raw PRG ROM mapped at 0x8000 - 0xFFFF, in 8K pages (see map_prg_bank)
+  const u8* prg_page [4] = { nullptr };
+
   /*----------------------------  Serialization  -----------------------------*/
 
 protected:
@@ -65,10 +78,12 @@ protected:
 
   virtual void update_banks() = 0;
 
-  virtual const Serializable::Chunk* deserialize(const Serializable::Chunk* c) override {
-    c = this->Serializable::deserialize(c);
+  virtual void state_loaded() override {
+    this->chr_cache->invalidate_all();
+    // re-mapping the loaded state's banks isn't the game switching banks
+    const u64 bank_switches = this->_stats.bank_switches;
     this->update_banks();
-    return c;
+    this->_stats.bank_switches = bank_switches;
   }
 
   /*-------------------------------  Helpers  --------------------------------*/
@@ -87,6 +102,12 @@ protected:
   uint get_chr_bank_len() const;
   ROM&    get_prg_bank(uint bank) const;
   Memory& get_chr_bank(uint bank) const;
+  // Same as get_prg_bank, but also exposes the bank's raw memory to the CPU
+  // (should be used by update_banks() when selecting banks for 0x8000-0xFFFF)
+  ROM&    map_prg_bank(u16 addr, uint bank);
+  // Same as get_chr_bank, but also tells the CHR cache where the bank is mapped
+  // (should be used by update_banks() when selecting banks for 0x0000-0x1FFF)
+  Memory& map_chr_bank(u16 addr, uint bank);
 
   /*--------------------------  External Interface  --------------------------*/
 
@@ -103,6 +124,12 @@ public:
     this->interrupt_line = interrupt_line;
   }
 
+  // Creates an independent copy of the mapper (with identical state), which
+  // shares PRG / CHR ROM (and decoded CHR ROM tiles) with this one.
+  // The returned Mapper is owned by the caller, and must not outlive the
+  // Cartridge this mapper (or the mapper it was cloned from) came from.
+  Mapper* clone() const;
+
   // ---- Mapper Queries ---- //
   const char* mapper_name()   const { return this->name;   };
         uint  mapper_number() const { return this->number; };
@@ -114,6 +141,36 @@ public:
   // ---- Callbacks ---- //
   CallbackManager<Mapper*> irq_callbacks;
 
+  // ---- Stats ---- //
+  // see NES_Stats
+  struct {
+    u64 bank_switches = 0;
+  } _stats;
+
+  // ---- Direct PRG ROM Access ---- //
+  // Returns a pointer to the PRG ROM mapped at CPU addr 0x8000 - 0xFFFF, or
+  // nullptr if the address isn't mapped through map_prg_bank.
+  // PRG ROM reads have no side effects, so it's fine to bypass read() entirely.
+  const u8* prg_rom_ptr(u16 addr) const {
+    const u8* page = this->prg_page[(addr - 0x8000) / 0x2000];
+    return page ? page + addr % 0x2000 : nullptr;
+  }
+  // Offset into the PRG ROM of the byte mapped at CPU addr 0x8000 - 0xFFFF
+  // (i.e: a bank-aware address), or -1 if it isn't mapped through map_prg_bank
+  int prg_rom_offset(u16 addr) const {
+    const u8* rom = this->prg_rom_ptr(addr);
+    return rom ? int(rom - this->rom_file.rom.prg.data) : -1;
+  }
+
+  // ---- Pre-decoded CHR ---- //
+  // Returns the 8 pixels (0 - 3) of the tile row at PPU addr 0x0000 - 0x1FFF
+  // (see CHR_Cache::row)
+  const u8* chr_tile_row(u16 addr, bool flip_h) const {
+    return this->chr_cache->row(addr, flip_h);
+  }
+  // Should be called after writing to 0x0000 - 0x1FFF (i.e: CHR RAM)
+  void chr_written(u16 addr) { this->chr_cache->invalidate(addr); }
+
   /*------------------------  Core Mapper Interface  -------------------------*/
 
   // reads tend to be side-effect free, except with some fancier mappers
@@ -134,6 +191,7 @@ public:
       for (uint j = 0; j < this->banks.chr.len; j++) {
         static_cast<RAM*>(this->banks.chr.bank[j])->clear();
       }
+      this->chr_cache->invalidate_all();
     }
     this->reset();
     this->update_banks();
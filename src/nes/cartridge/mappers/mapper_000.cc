@@ -31,8 +31,8 @@ void Mapper_000::write(u16 addr, u8 val) {
 }
 
 void Mapper_000::update_banks() {
-  this->prg_lo = &this->get_prg_bank(0);
-  this->prg_hi = &this->get_prg_bank(1); // Same as bank 0 when only 16K PRG ROM
+  this->prg_lo = &this->map_prg_bank(0x8000, 0);
+  this->prg_hi = &this->map_prg_bank(0xC000, 1); // Same as bank 0 when only 16K PRG ROM
 
-  this->chr_mem = &this->get_chr_bank(0);
+  this->chr_mem = &this->map_chr_bank(0x0000, 0);
 }
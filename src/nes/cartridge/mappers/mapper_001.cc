@@ -91,18 +91,18 @@ void Mapper_001::update_banks() {
   switch(u8(this->reg.control.prg_bank_mode)) {
   case 0: case 1: {
     // switch 32 KB at $8000, ignoring low bit of bank number
-    this->prg_lo = &this->get_prg_bank(this->reg.prg.bank & 0xFE);
-    this->prg_hi = &this->get_prg_bank(this->reg.prg.bank | 0x01);
+    this->prg_lo = &this->map_prg_bank(0x8000, this->reg.prg.bank & 0xFE);
+    this->prg_hi = &this->map_prg_bank(0xC000, this->reg.prg.bank | 0x01);
   } break;
   case 2: {
     // fix first bank at $8000 and switch 16 KB bank at $C000;
-    this->prg_lo = &this->get_prg_bank(0);
-    this->prg_hi = &this->get_prg_bank(this->reg.prg.bank);
+    this->prg_lo = &this->map_prg_bank(0x8000, 0);
+    this->prg_hi = &this->map_prg_bank(0xC000, this->reg.prg.bank);
   } break;
   case 3: {
     // fix last bank at $C000 and switch 16 KB bank at $8000
-    this->prg_lo = &this->get_prg_bank(this->reg.prg.bank);
-    this->prg_hi = &this->get_prg_bank(this->get_prg_bank_len() - 1);
+    this->prg_lo = &this->map_prg_bank(0x8000, this->reg.prg.bank);
+    this->prg_hi = &this->map_prg_bank(0xC000, this->get_prg_bank_len() - 1);
   } break;
   default:
     // This should never happen. 2 bits == 4 possible states.
@@ -115,12 +115,12 @@ void Mapper_001::update_banks() {
   // Update CHR Banks
   if (this->reg.control.chr_bank_mode == 0) {
     // switch 8 KB at a time (ignoring low bit)
-    this->chr_lo = &this->get_chr_bank(this->reg.chr0.bank & 0xFE);
-    this->chr_hi = &this->get_chr_bank(this->reg.chr0.bank | 0x01);
+    this->chr_lo = &this->map_chr_bank(0x0000, this->reg.chr0.bank & 0xFE);
+    this->chr_hi = &this->map_chr_bank(0x1000, this->reg.chr0.bank | 0x01);
   } else {
     // switch two separate 4 KB banks
-    this->chr_lo = &this->get_chr_bank(this->reg.chr0.bank);
-    this->chr_hi = &this->get_chr_bank(this->reg.chr1.bank);
+    this->chr_lo = &this->map_chr_bank(0x0000, this->reg.chr0.bank);
+    this->chr_hi = &this->map_chr_bank(0x1000, this->reg.chr1.bank);
   }
 }
 
@@ -39,10 +39,10 @@ void Mapper_002::write(u16 addr, u8 val) {
 }
 
 void Mapper_002::update_banks() {
-  this->prg_lo = &this->get_prg_bank(this->reg.bank_select);
-  this->prg_hi = &this->get_prg_bank(this->get_prg_bank_len() - 1); // Fixed
+  this->prg_lo = &this->map_prg_bank(0x8000, this->reg.bank_select);
+  this->prg_hi = &this->map_prg_bank(0xC000, this->get_prg_bank_len() - 1); // Fixed
 
-  this->chr_mem = &this->get_chr_bank(0);
+  this->chr_mem = &this->map_chr_bank(0x0000, 0);
 }
 
 void Mapper_002::reset() {
@@ -39,10 +39,10 @@ void Mapper_003::write(u16 addr, u8 val) {
 }
 
 void Mapper_003::update_banks() {
-  this->prg_lo = &this->get_prg_bank(0);
-  this->prg_hi = &this->get_prg_bank(1);
+  this->prg_lo = &this->map_prg_bank(0x8000, 0);
+  this->prg_hi = &this->map_prg_bank(0xC000, 1);
 
-  this->chr_mem = &this->get_chr_bank(this->reg.bank_select);
+  this->chr_mem = &this->map_chr_bank(0x0000, this->reg.bank_select);
 }
 
 void Mapper_003::reset() {
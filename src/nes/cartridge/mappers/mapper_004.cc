@@ -129,7 +129,7 @@ void Mapper_004::write(u16 addr, u8 val) {
 void Mapper_004::update_banks() {
   // https://wiki.nesdev.com/w/index.php/MMC3#PRG_Banks
   #define PBANK(i, val) \
-    this->prg_bank[i] = &this->get_prg_bank(val);
+    this->prg_bank[i] = &this->map_prg_bank(0x8000 + i * 0x2000, val);
   if (this->reg.bank_select.prg_rom_mode == 0) {
     PBANK(0, this->reg.bank_values[6]);
     PBANK(1, this->reg.bank_values[7]);
@@ -145,7 +145,7 @@ void Mapper_004::update_banks() {
 
   // https://wiki.nesdev.com/w/index.php/MMC3#CHR_Banks
   #define CBANK(i, val) \
-    this->chr_bank[i] = &this->get_chr_bank(val);
+    this->chr_bank[i] = &this->map_chr_bank(i * 0x400, val);
   if (this->reg.bank_select.chr_inversion == 0) {
     CBANK(0, this->reg.bank_values[0] & 0xFE);
     CBANK(1, this->reg.bank_values[0] | 0x01);
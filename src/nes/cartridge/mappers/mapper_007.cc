@@ -45,10 +45,10 @@ Mirroring::Type Mapper_007::mirroring() const {
 }
 
 void Mapper_007::update_banks() {
-  this->prg_lo = &this->get_prg_bank(this->reg.bank_select.prg_bank * 2 + 0);
-  this->prg_hi = &this->get_prg_bank(this->reg.bank_select.prg_bank * 2 + 1);
+  this->prg_lo = &this->map_prg_bank(0x8000, this->reg.bank_select.prg_bank * 2 + 0);
+  this->prg_hi = &this->map_prg_bank(0xC000, this->reg.bank_select.prg_bank * 2 + 1);
 
-  this->chr_mem = &this->get_chr_bank(0);
+  this->chr_mem = &this->map_chr_bank(0x0000, 0);
 }
 
 void Mapper_007::reset() {
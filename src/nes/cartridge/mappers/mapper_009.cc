@@ -66,17 +66,21 @@ void Mapper_009::write(u16 addr, u8 val) {
 void Mapper_009::update_banks() {
   // Update PRG Banks
   // Swappable first PRG ROM bank
-  this->prg_rom[0] = &this->get_prg_bank(this->reg.prg.bank);
+  this->prg_rom[0] = &this->map_prg_bank(0x8000, this->reg.prg.bank);
   // Fix last-3 PRG ROM banks
-  this->prg_rom[1] = &this->get_prg_bank(this->get_prg_bank_len() - 3);
-  this->prg_rom[2] = &this->get_prg_bank(this->get_prg_bank_len() - 2);
-  this->prg_rom[3] = &this->get_prg_bank(this->get_prg_bank_len() - 1);
+  this->prg_rom[1] = &this->map_prg_bank(0xA000, this->get_prg_bank_len() - 3);
+  this->prg_rom[2] = &this->map_prg_bank(0xC000, this->get_prg_bank_len() - 2);
+  this->prg_rom[3] = &this->map_prg_bank(0xE000, this->get_prg_bank_len() - 1);
 
   // Update CHR Banks
   this->chr_rom.lo[0] = &this->get_chr_bank(this->reg.chr.lo[0].bank);
   this->chr_rom.lo[1] = &this->get_chr_bank(this->reg.chr.lo[1].bank);
   this->chr_rom.hi[0] = &this->get_chr_bank(this->reg.chr.hi[0].bank);
   this->chr_rom.hi[1] = &this->get_chr_bank(this->reg.chr.hi[1].bank);
+
+  // Only the latched banks are visible to the PPU
+  this->map_chr_bank(0x0000, this->reg.chr.lo[this->reg.latch[0]].bank);
+  this->map_chr_bank(0x1000, this->reg.chr.hi[this->reg.latch[1]].bank);
 }
 
 Mirroring::Type Mapper_009::mirroring() const {
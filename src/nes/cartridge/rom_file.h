@@ -35,5 +35,5 @@ struct ROM_File {
     } misc;
   } rom;
 
-  ~ROM_File() { delete this->data; }
+  ~ROM_File() { delete[] this->data; }
 };
@@ -2,18 +2,25 @@
 
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>
 #include <cassert>
 
 /*-----------------------------  Public Methods  -----------------------------*/
 
-CPU::CPU(const NES_Params& params, Memory& mem, InterruptLines& interrupt)
+CPU::CPU(const NES_Params& params, CPU_MMU& mem, InterruptLines& interrupt)
 : interrupt(interrupt)
 , mem(mem)
-, print_nestest(params.log_cpu)
+, log_cpu(params.log_cpu)
+, profile_cpu(params.profile_cpu)
 {
   this->power_cycle();
 }
 
+CPU::~CPU() {
+  delete this->trace_ring;
+  delete this->profiler;
+}
+
 // https://wiki.nesdev.com/w/index.php/CPU_power_up_state
 void CPU::power_cycle() {
   this->cycles = 0;
@@ -27,10 +34,13 @@ void CPU::power_cycle() {
   this->reg.s = 0xFD;
 
   this->is_running = true;
+
+  this->idle.state = Idle::OFF;
 }
 
 void CPU::reset() {
   this->is_running = true;
+  this->idle.state = Idle::OFF;
   // RESET interrupt should be asserted exterally
 }
 
@@ -63,10 +73,13 @@ void CPU::service_interrupt(Interrupts::Type interrupt, bool brk /* = false */)
   case Interrupts::IRQ:
     if (brk || !this->reg.p.i) {
       this->reg.pc = this->read16(0xFFFE);
+      if (!brk) this->_stats.irqs++;
     }
     break;
   case Interrupts::RESET: this->reg.pc = this->read16(0xFFFC); break;
-  case Interrupts::NMI:   this->reg.pc = this->read16(0xFFFA); break;
+  case Interrupts::NMI:   this->reg.pc = this->read16(0xFFFA);
+                          this->_stats.nmis++;
+                          break;
   default: break;
   }
 
@@ -83,10 +96,10 @@ u16 CPU::get_operand_addr(const Instructions::Opcode& opcode) {
 
   // To keep switch-statement code clean, define some temporary macros that
   // read 8 and 1 bit arguments (respectively)
-  #define arg8  (this->mem[this->reg.pc++])
-  #define arg16 (this->read16((this->reg.pc += 2) - 2))
+  #define arg8  (this->fetch())
+  #define arg16 (this->fetch16())
 
-  #define dummy_read() this->mem.read(this->reg.pc)
+  #define dummy_read() this->mem.fetch(this->reg.pc)
 
   switch(opcode.addrm) {
     case abs_: addr = arg16;                                             break;
@@ -132,23 +145,64 @@ u16 CPU::get_operand_addr(const Instructions::Opcode& opcode) {
 uint CPU::step() {
   uint old_cycles = this->cycles;
 
+  // Idle loop replays don't go through trace(), so while tracing, every
+  // instruction has to actually run (log_cpu can be turned on mid-replay)
+#ifdef NESTEST
+  this->idle.state = Idle::OFF;
+#else
+  if (this->log_cpu)
+    this->idle.state = Idle::OFF;
+#endif
+
   // Service pending interrupts
   if (Interrupts::Type interrupt = this->interrupt.get()) {
+    this->idle.state = Idle::OFF;
+    const u16 pc = this->reg.pc;
+    const u8  sp = this->reg.s;
     this->service_interrupt(interrupt);
+    if (this->profile_cpu)
+      this->profile_interrupt(interrupt, pc, sp, this->cycles - old_cycles);
     return this->cycles - old_cycles;
   }
 
+  this->_stats.instrs++;
+
+  // Replay idle loop
+  if (this->idle.state == Idle::IDLE) {
+    const auto& instr = this->idle.instr[this->idle.i];
+    this->idle.i = (this->idle.i + 1) % this->idle.len;
+
+    if (this->profile_cpu) {
+      const u16 pc = this->reg.pc;
+      this->_profiler().instr(this->profile_key(pc), pc, instr.cycles);
+    }
+
+    memcpy(&this->reg, &instr.reg, sizeof this->reg);
+    this->cycles += instr.cycles;
+    return instr.cycles;
+  }
+
+  const u16 pc = this->reg.pc;
+
   // Fetch current opcode
-  u8 op = this->mem[this->reg.pc++];
+  // NOTE: there's deliberately no cache of decoded instructions. Opcodes and
+  // operands in PRG ROM are already read straight out of the mapped ROM page,
+  // and caching decoded instructions by PRG ROM offset measured ~7% *slower*
+  // in anese_bench's cpu.step.
+  u8 op = this->fetch();
 
   // Lookup info about opcode
-  Instructions::Opcode opcode = Instructions::Opcodes[op];
+  const Instructions::Opcode& opcode = Instructions::Opcodes[op];
 
-  if (this->print_nestest) {
-    this->nestest(*this, opcode);
-  }
 #ifdef NESTEST
-  this->nestest(*this, opcode);
+  // headless nestest: print every instruction, in the golden log's format
+  this->trace(pc, opcode);
+  char line [CPU_TraceEntry::NESTEST_LEN];
+  this->trace_ring->newest().to_nestest(line);
+  puts(line);
+#else
+  if (this->log_cpu)
+    this->trace(pc, opcode);
 #endif
 
   u16 addr = this->get_operand_addr(opcode);
@@ -157,6 +211,11 @@ uint CPU::step() {
 
   // Define some macros used across multiple instructions
 
+  // Read the instruction's operand
+  // Same as this->mem[addr], except that operands in PRG ROM (eg: immediates,
+  // or lookup tables) skip the bus entirely. See CPU_MMU::fetch.
+  #define operand() this->mem.fetch(addr)
+
   // Set Zero and Negative flags
   #define set_zn(val) \
     this->reg.p.z = val == 0; \
@@ -165,7 +224,7 @@ uint CPU::step() {
   // Branch if condition is satisfied
   #define branch(cond)                                                 \
     if (!cond) break;                                                  \
-    i8 offset = i8(this->mem[addr]);                                   \
+    i8 offset = i8(operand());                                         \
     /* Extra cycle on succesful branch */                              \
     this->cycles += 1;                                                 \
     /* Check if extra cycles due to jumping across pages */            \
@@ -177,7 +236,7 @@ uint CPU::step() {
   // compiled down to a jump table!
   // Don't believe me? Check godbolt!
   switch (opcode.instr) {
-      case ADC: { u8  val = this->mem[addr];
+      case ADC: { u8  val = operand();
                   u16 sum = this->reg.a + val + this->reg.p.c;
                   this->reg.p.c = sum > 0xFF;
                   this->reg.p.z = u8(sum) == 0;
@@ -188,7 +247,7 @@ uint CPU::step() {
                   this->reg.p.n = nth_bit(u8(sum), 7);
                   this->reg.a = u8(sum);
                 } break;
-      case AND: { this->reg.a &= this->mem[addr];
+      case AND: { this->reg.a &= operand();
                   set_zn(this->reg.a);
                 } break;
       case ASL: { if (opcode.addrm == Instructions::AddrM::acc) {
@@ -196,7 +255,7 @@ uint CPU::step() {
                     this->reg.a <<= 1;
                     set_zn(this->reg.a);
                   } else {
-                    u8 val = this->mem[addr];
+                    u8 val = operand();
                     this->mem[addr] = val; // dummy-write
                     this->reg.p.c = nth_bit(val, 7);
                     val <<= 1;
@@ -210,7 +269,7 @@ uint CPU::step() {
                 } break;
       case BEQ: { branch(this->reg.p.z);
                 } break;
-      case BIT: { u8 mem = this->mem[addr];
+      case BIT: { u8 mem = operand();
                   this->reg.p.z = (this->reg.a & mem) == 0;
                   this->reg.p.v = nth_bit(mem, 6);
                   this->reg.p.n = nth_bit(mem, 7);
@@ -236,19 +295,19 @@ uint CPU::step() {
                 } break;
       case CLV: { this->reg.p.v = 0;
                 } break;
-      case CMP: { u8 val = this->mem[addr];
+      case CMP: { u8 val = operand();
                   this->reg.p.c = this->reg.a >= val;
                   set_zn(this->reg.a - val);
                 } break;
-      case CPX: { u8 val = this->mem[addr];
+      case CPX: { u8 val = operand();
                   this->reg.p.c = this->reg.x >= val;
                   set_zn(this->reg.x - val);
                 } break;
-      case CPY: { u8 val = this->mem[addr];
+      case CPY: { u8 val = operand();
                   this->reg.p.c = this->reg.y >= val;
                   set_zn(this->reg.y - val);
                 } break;
-      case DEC: { u8 val = this->mem[addr];
+      case DEC: { u8 val = operand();
                   this->mem[addr] = val; // dummy-write
                   val--;
                   set_zn(val);
@@ -260,10 +319,10 @@ uint CPU::step() {
       case DEY: { this->reg.y--;
                   set_zn(this->reg.y);
                 } break;
-      case EOR: { this->reg.a ^= this->mem[addr];
+      case EOR: { this->reg.a ^= operand();
                   set_zn(this->reg.a);
                 } break;
-      case INC: { u8 val = this->mem[addr];
+      case INC: { u8 val = operand();
                   this->mem[addr] = val; // dummy-write
                   val++;
                   set_zn(val);
@@ -280,13 +339,13 @@ uint CPU::step() {
       case JSR: { this->s_push16(this->reg.pc - 1);
                   this->reg.pc = addr;
                 } break;
-      case LDA: { this->reg.a = this->mem[addr];
+      case LDA: { this->reg.a = operand();
                   set_zn(this->reg.a);
                 } break;
-      case LDX: { this->reg.x = this->mem[addr];
+      case LDX: { this->reg.x = operand();
                   set_zn(this->reg.x);
                 } break;
-      case LDY: { this->reg.y = this->mem[addr];
+      case LDY: { this->reg.y = operand();
                   set_zn(this->reg.y);
                 } break;
       case LSR: { if (opcode.addrm == Instructions::AddrM::acc) {
@@ -294,7 +353,7 @@ uint CPU::step() {
                     this->reg.a >>= 1;
                     set_zn(this->reg.a);
                   } else {
-                    u8 val = this->mem[addr];
+                    u8 val = operand();
                     this->mem[addr] = val; // dummy-write
                     this->reg.p.c = nth_bit(val, 0);
                     val >>= 1;
@@ -304,7 +363,7 @@ uint CPU::step() {
                 } break;
       case NOP: { // me_irl
                 } break;
-      case ORA: { this->reg.a |= this->mem[addr];
+      case ORA: { this->reg.a |= operand();
                   set_zn(this->reg.a);
                 } break;
       case PHA: { this->s_push(this->reg.a);
@@ -322,7 +381,7 @@ uint CPU::step() {
                     this->reg.p.c = old_bit_0;
                     set_zn(this->reg.a);
                   } else {
-                    u8 val = this->mem[addr];
+                    u8 val = operand();
                     this->mem[addr] = val; // dummy-write
                     bool old_bit_0 = nth_bit(val, 7);
                     val = (val << 1) | u8(this->reg.p.c);
@@ -337,7 +396,7 @@ uint CPU::step() {
                     this->reg.p.c = old_bit_0;
                     set_zn(this->reg.a);
                   } else {
-                    u8 val = this->mem[addr];
+                    u8 val = operand();
                     this->mem[addr] = val; // dummy-write
                     bool old_bit_0 = nth_bit(val, 0);
                     val = (val >> 1) | (this->reg.p.c << 7);
@@ -351,7 +410,7 @@ uint CPU::step() {
                 } break;
       case RTS: { this->reg.pc = this->s_pull16() + 1;
                 } break;
-      case SBC: { u8  val = this->mem[addr];
+      case SBC: { u8  val = operand();
                   u16 sum = this->reg.a + ~val + this->reg.p.c;
                   this->reg.p.c = !(sum > 0xFF);
                   this->reg.p.z = u8(sum) == 0;
@@ -397,16 +456,221 @@ uint CPU::step() {
         this->cycles,
         opcode.raw
       );
+      this->dump_trace();
       this->is_running = false;
       break;
   }
 
   this->cycles += opcode.cycles;
+
+  if (!this->log_cpu)
+    this->track_idle(opcode, pc, addr, this->cycles - old_cycles);
+
+  if (this->profile_cpu)
+    this->profile(pc, opcode, this->cycles - old_cycles);
+
   return this->cycles - old_cycles;
 }
 
+/*----------  Idle Loop Detection  ----------*/
+
+// Instructions that only read from RAM / PRG ROM, and don't touch the stack
+bool CPU::is_idle_safe(const Instructions::Opcode& opcode, u16 pc, u16 addr) const {
+  using namespace Instructions::Instr;
+  using namespace Instructions::AddrM;
+
+  #define is_plain_mem(a) ((a) < 0x2000 || this->mem.is_prg_rom(a))
+
+  if (!is_plain_mem(pc)) return false;
+
+  switch (opcode.instr) {
+  // read memory
+  case ADC: case AND: case BIT: case CMP: case CPX: case CPY: case EOR:
+  case LDA: case LDX: case LDY: case ORA: case SBC:
+    switch (opcode.addrm) {
+    case imm:  return true;
+    case ind_: return false;
+    default:   return is_plain_mem(addr);
+    }
+  // only modify the accumulator
+  case ASL: case LSR: case ROL: case ROR:
+    return opcode.addrm == acc;
+  // only modify registers
+  case BCC: case BCS: case BEQ: case BMI: case BNE: case BPL: case BVC:
+  case BVS: case CLC: case CLD: case CLI: case CLV: case DEX: case DEY:
+  case INX: case INY: case NOP: case SEC: case SED: case SEI: case TAX:
+  case TAY: case TSX: case TXA: case TXS: case TYA:
+    return true;
+  case JMP:
+    return opcode.addrm == abs_;
+  default:
+    return false;
+  }
+
+  #undef is_plain_mem
+}
+
+void CPU::track_idle(
+  const Instructions::Opcode& opcode,
+  u16 pc, u16 addr,
+  uint cycles
+) {
+  #define same_regs(r1, r2) (                                    \
+    r1.pc == r2.pc && r1.s == r2.s && r1.p.raw == r2.p.raw &&    \
+    r1.a  == r2.a  && r1.x == r2.x && r1.y     == r2.y           \
+  )
+
+  switch (this->idle.state) {
+  case Idle::OFF: {
+    // Start probing on short backwards jumps
+    const bool is_short_loop = this->reg.pc <= pc && pc - this->reg.pc < 16;
+    if (is_short_loop && this->is_idle_safe(opcode, pc, addr)) {
+      this->idle.state = Idle::PROBING;
+      memcpy(&this->idle.head, &this->reg, sizeof this->reg);
+      this->idle.len = 0;
+    }
+  } break;
+  case Idle::PROBING: {
+    const uint len = sizeof this->idle.instr / sizeof this->idle.instr[0];
+    if (this->idle.len == len || !this->is_idle_safe(opcode, pc, addr)) {
+      this->idle.state = Idle::OFF;
+      break;
+    }
+
+    memcpy(&this->idle.instr[this->idle.len].reg, &this->reg, sizeof this->reg);
+    this->idle.instr[this->idle.len].cycles = cycles;
+    this->idle.len++;
+
+    // Back at the top of the loop?
+    if (this->reg.pc == this->idle.head.pc) {
+      if (same_regs(this->reg, this->idle.head)) {
+        this->idle.state = Idle::IDLE;
+        this->idle.i = 0;
+      } else {
+        // Nope, some register changed. Give it another iteration.
+        memcpy(&this->idle.head, &this->reg, sizeof this->reg);
+        this->idle.len = 0;
+      }
+    }
+  } break;
+  case Idle::IDLE: break; // never reached (step replays the loop instead)
+  }
+
+  #undef same_regs
+}
+
+/*----------  Instruction Trace  ----------*/
+
+void CPU::trace(u16 pc, const Instructions::Opcode& opcode) {
+  using namespace Instructions::AddrM;
+
+  CPU_TraceRing& ring = this->_trace();
+
+  CPU_TraceEntry e;
+  e.cycles   = this->cycles;
+  e.pc       = pc;
+  e.scanline = ring.scanline;
+  e.dot      = ring.dot;
+  e.op       = opcode.raw;
+  e.arg[0]   = this->mem.peek(pc + 1);
+  e.arg[1]   = this->mem.peek(pc + 2);
+  e.a        = this->reg.a;
+  e.x        = this->reg.x;
+  e.y        = this->reg.y;
+  e.p        = this->reg.p.raw;
+  e.s        = this->reg.s;
+
+  // Resolve the effective address without touching the bus (i.e: peeks only)
+  const u8  arg8  = e.arg[0];
+  const u16 arg16 = e.arg[0] | (e.arg[1] << 8);
+
+  e.ptr = 0;
+  u16 addr = 0;
+  switch (opcode.addrm) {
+    case abs_: addr = arg16;                                             break;
+    case absX: addr = arg16 + this->reg.x;                               break;
+    case absY: addr = arg16 + this->reg.y;                               break;
+    case ind_: e.ptr = this->peek16_zpg(arg16);                          break;
+    case indY: e.ptr = this->peek16_zpg(arg8);
+               addr = e.ptr + this->reg.y;                               break;
+    case Xind: e.ptr = this->peek16_zpg(u8(arg8 + this->reg.x));
+               addr = e.ptr;                                             break;
+    case zpg_: addr = arg8;                                              break;
+    case zpgX: addr = u8(arg8 + this->reg.x);                            break;
+    case zpgY: addr = u8(arg8 + this->reg.y);                            break;
+    default: break;
+  }
+
+  switch (opcode.addrm) {
+    case abs_: case absX: case absY:
+    case indY: case Xind:
+    case zpg_: case zpgX: case zpgY:
+      e.val = this->mem.peek(addr);
+      break;
+    default:
+      e.val = 0;
+      break;
+  }
+
+  ring.push(e);
+}
+
+void CPU::dump_trace() const {
+  if (!this->trace_ring) return;
+  const CPU_TraceRing& ring = *this->trace_ring;
+
+  const u64 len = ring.written();
+  const u64 n = len < 16 ? len : 16;
+
+  fprintf(stderr, "[CPU] Last %u instructions:\n", uint(n));
+  char line [CPU_TraceEntry::NESTEST_LEN];
+  for (u64 i = len - n; i < len; i++) {
+    ring[i].to_nestest(line);
+    fprintf(stderr, "  %s\n", line);
+  }
+}
+
+/*----------  Profiling  ----------*/
+
+void CPU::profile(u16 pc, const Instructions::Opcode& opcode, uint cycles) {
+  using namespace Instructions::Instr;
+
+  CPU_Profiler& prof = this->_profiler();
+  prof.instr(this->profile_key(pc), pc, cycles);
+
+  // the stack pointers passed along are from before the return address was
+  // pushed / after it was pulled (see CPU_Profiler)
+  switch (opcode.instr) {
+  case JSR: prof.call(this->profile_key(this->reg.pc), u8(this->reg.s + 2));
+            break;
+  case BRK: prof.call(this->profile_key(this->reg.pc), u8(this->reg.s + 3));
+            break;
+  case RTS:
+  case RTI: prof.ret(this->reg.s);
+            break;
+  default: break;
+  }
+}
+
+void CPU::profile_interrupt(Interrupts::Type type, u16 pc, u8 sp, uint cycles) {
+  CPU_Profiler& prof = this->_profiler();
+  if (type == Interrupts::RESET) {
+    prof.reset_stack();
+  } else if (this->reg.pc != pc) {
+    // the interrupt's cycles are charged to the handler
+    prof.call(this->profile_key(this->reg.pc), sp, cycles);
+  }
+}
+
 /*----------  Helpers  ----------*/
 
+u8  CPU::fetch()   { return this->mem.fetch(this->reg.pc++); }
+u16 CPU::fetch16() {
+  u16 lo = this->fetch();
+  u16 hi = this->fetch();
+  return (hi << 8) | lo;
+}
+
 u8   CPU::s_pull()       { return this->mem[0x0100 + ++this->reg.s]; }
 void CPU::s_push(u8 val) { this->mem[0x0100 + this->reg.s--] = val;  }
 
@@ -0,0 +1,220 @@
+#include "profiler.h"
+
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+
+CPU_Profiler::~CPU_Profiler() {
+  delete[] this->pcs;
+  delete[] this->nodes;
+}
+
+CPU_Profiler::CPU_Profiler() {
+  this->clear();
+}
+
+void CPU_Profiler::clear() {
+  delete[] this->pcs;
+  this->pcs_len = 0x10000;
+  this->pcs = new PC [this->pcs_len];
+  memset(this->pcs, 0, sizeof(PC) * this->pcs_len);
+
+  delete[] this->nodes;
+  this->nodes_cap = 1024;
+  this->nodes = new Node [this->nodes_cap];
+  this->nodes_len = 1;
+  this->nodes[0] = { ROOT, 0, 0, 0, 0, 0 };
+
+  this->depth = 0;
+  this->node = 0;
+  this->total = 0;
+}
+
+void CPU_Profiler::grow_pcs(u32 key) {
+  uint len = this->pcs_len;
+  while (len <= key) len *= 2;
+
+  PC* pcs = new PC [len];
+  memcpy(pcs, this->pcs, sizeof(PC) * this->pcs_len);
+  memset(pcs + this->pcs_len, 0, sizeof(PC) * (len - this->pcs_len));
+
+  delete[] this->pcs;
+  this->pcs = pcs;
+  this->pcs_len = len;
+}
+
+u32 CPU_Profiler::child(u32 parent, u32 key) {
+  u32 prev = 0;
+  for (u32 i = this->nodes[parent].child; i; i = this->nodes[i].sibling) {
+    if (this->nodes[i].key == key) return i;
+    prev = i;
+  }
+
+  if (this->nodes_len == MAX_NODES) return parent; // just stay put
+
+  if (this->nodes_len == this->nodes_cap) {
+    Node* nodes = new Node [this->nodes_cap * 2];
+    memcpy(nodes, this->nodes, sizeof(Node) * this->nodes_len);
+    delete[] this->nodes;
+    this->nodes = nodes;
+    this->nodes_cap *= 2;
+  }
+
+  const u32 i = this->nodes_len++;
+  this->nodes[i] = { key, parent, 0, 0, 0, 0 };
+  if (prev) this->nodes[prev].sibling = i;
+  else      this->nodes[parent].child = i;
+  return i;
+}
+
+void CPU_Profiler::unwind(u8 sp) {
+  while (this->depth && this->stack[this->depth - 1].sp <= sp)
+    this->depth--;
+  this->node = this->depth ? this->stack[this->depth - 1].node : 0;
+}
+
+void CPU_Profiler::call(u32 key, u8 sp, uint cycles) {
+  // any frames at (or above) this stack level were abandoned
+  this->unwind(sp);
+
+  if (this->depth < MAX_DEPTH) {
+    this->node = this->child(this->node, key);
+    this->stack[this->depth++] = { this->node, sp };
+  }
+
+  this->nodes[this->node].calls++;
+  this->nodes[this->node].cycles += cycles;
+  this->total += cycles;
+}
+
+/*--------------------------------  Output  --------------------------------*/
+
+void CPU_Profiler::label(u32 key, char* buf) const {
+  if (key == ROOT)
+    sprintf(buf, "main");
+  else if (key >= 0x10000) // PRG ROM, as 8K bank : CPU address
+    sprintf(buf, "%02X:%04X",
+      (key - 0x10000) / 0x2000,
+      key < this->pcs_len ? this->pcs[key].addr : 0);
+  else
+    sprintf(buf, "$%04X", key);
+}
+
+namespace {
+
+struct Row {
+  u32 key;
+  u64 cycles; // self
+  u64 incl;
+  u64 calls;
+};
+
+int by_key(const void* a, const void* b) {
+  const u32 x = ((const Row*)a)->key, y = ((const Row*)b)->key;
+  return x < y ? -1 : x > y;
+}
+int by_cycles(const void* a, const void* b) {
+  const u64 x = ((const Row*)a)->cycles, y = ((const Row*)b)->cycles;
+  return x > y ? -1 : x < y;
+}
+int by_incl(const void* a, const void* b) {
+  const u64 x = ((const Row*)a)->incl, y = ((const Row*)b)->incl;
+  return x > y ? -1 : x < y;
+}
+
+} // namespace
+
+void CPU_Profiler::write_report(FILE* f, uint max_rows) const {
+  char buf [16];
+  const double total = this->total ? double(this->total) : 1.0;
+
+  fprintf(f, "CPU profile: %" PRIu64 " cycles\n", this->total);
+
+  // ---- Instructions ---- //
+
+  uint len = 0;
+  for (uint i = 0; i < this->pcs_len; i++)
+    len += this->pcs[i].count != 0;
+
+  Row* rows = new Row [len > this->nodes_len ? len : this->nodes_len];
+
+  len = 0;
+  for (uint i = 0; i < this->pcs_len; i++)
+    if (this->pcs[i].count)
+      rows[len++] = { i, this->pcs[i].cycles, 0, this->pcs[i].count };
+  qsort(rows, len, sizeof(Row), by_cycles);
+
+  fprintf(f, "\nHottest instructions:\n");
+  fprintf(f, "%14s %7s %12s  %s\n", "cycles", "%", "count", "address");
+  for (uint i = 0; i < len && i < max_rows; i++) {
+    this->label(rows[i].key, buf);
+    fprintf(f, "%14" PRIu64 " %6.2f%% %12" PRIu64 "  %s\n",
+      rows[i].cycles, rows[i].cycles * 100 / total, rows[i].calls, buf);
+  }
+
+  // ---- Subroutines ---- //
+
+  // inclusive cycles of every node's subtree (children come after parents)
+  u64* incl = new u64 [this->nodes_len];
+  for (uint i = 0; i < this->nodes_len; i++)
+    incl[i] = this->nodes[i].cycles;
+  for (uint i = this->nodes_len - 1; i > 0; i--)
+    incl[this->nodes[i].parent] += incl[i];
+
+  for (uint i = 0; i < this->nodes_len; i++) {
+    const Node& node = this->nodes[i];
+    // don't count recursive calls twice
+    bool recursive = false;
+    for (u32 p = i; p != 0 && !recursive; ) {
+      p = this->nodes[p].parent;
+      recursive = this->nodes[p].key == node.key;
+    }
+    rows[i] = { node.key, node.cycles, recursive ? 0 : incl[i], node.calls };
+  }
+  delete[] incl;
+
+  // merge rows for the same subroutine
+  qsort(rows, this->nodes_len, sizeof(Row), by_key);
+  len = 0;
+  for (uint i = 0; i < this->nodes_len; i++) {
+    if (len && rows[len - 1].key == rows[i].key) {
+      rows[len - 1].cycles += rows[i].cycles;
+      rows[len - 1].incl   += rows[i].incl;
+      rows[len - 1].calls  += rows[i].calls;
+    } else {
+      rows[len++] = rows[i];
+    }
+  }
+  qsort(rows, len, sizeof(Row), by_incl);
+
+  fprintf(f, "\nHottest subroutines:\n");
+  fprintf(f, "%14s %7s %14s %7s %12s  %s\n",
+    "inclusive", "%", "self", "%", "calls", "address");
+  for (uint i = 0; i < len && i < max_rows; i++) {
+    this->label(rows[i].key, buf);
+    fprintf(f, "%14" PRIu64 " %6.2f%% %14" PRIu64 " %6.2f%% %12" PRIu64 "  %s\n",
+      rows[i].incl,   rows[i].incl   * 100 / total,
+      rows[i].cycles, rows[i].cycles * 100 / total,
+      rows[i].calls, buf);
+  }
+
+  delete[] rows;
+}
+
+void CPU_Profiler::write_stack(FILE* f, u32 node) const {
+  if (node != 0) {
+    this->write_stack(f, this->nodes[node].parent);
+    fputc(';', f);
+  }
+  char buf [16];
+  this->label(this->nodes[node].key, buf);
+  fputs(buf, f);
+}
+
+void CPU_Profiler::write_folded(FILE* f) const {
+  for (uint i = 0; i < this->nodes_len; i++) {
+    if (!this->nodes[i].cycles) continue;
+    this->write_stack(f, i);
+    fprintf(f, " %" PRIu64 "\n", this->nodes[i].cycles);
+  }
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdio>
+
+#include "common/util.h"
+
+// Per-PC / per-subroutine CPU profiler
+// Accumulates the CPU cycles spent at every instruction address, and in every
+// call stack (tracked through JSR / RTS, and interrupts / RTI).
+//
+// Addresses are bank-aware: code in PRG ROM is keyed by its offset into the
+// ROM (so the same $8000 in two different banks counts separately), while
+// code running anywhere else (eg: RAM) is keyed by its CPU address.
+//
+// Games don't always return from subroutines (eg: popping the return address
+// and JMP-ing elsewhere), so frames are matched up with the stack pointer:
+// a frame ends as soon as the stack pointer climbs back to (or above) where it
+// was when the frame was entered.
+class CPU_Profiler final {
+public:
+  // Key of the instruction at addr, given its offset into PRG ROM (or -1 if
+  // it's not running from PRG ROM)
+  static u32 key(int prg_rom_offset, u16 addr) {
+    return prg_rom_offset < 0 ? addr : 0x10000 + prg_rom_offset;
+  }
+
+private:
+  static constexpr u32  ROOT       = 0xFFFFFFFF; // key of the root frame
+  static constexpr uint MAX_DEPTH  = 64;
+  static constexpr uint MAX_NODES  = 1 << 20;
+
+  // Per-PC counters (indexed by key)
+  struct PC {
+    u64 cycles;
+    u32 count; // times executed
+    u16 addr;  // CPU address the instruction was last executed at
+  };
+  PC* pcs = nullptr;
+  uint pcs_len = 0;
+
+  // Call tree (a node per unique call stack)
+  // Children are always created after their parents (i.e: have higher ids)
+  struct Node {
+    u32 key;     // subroutine entry point
+    u32 parent;
+    u32 child;   // first child (0 if none, since the root can't be a child)
+    u32 sibling; // next sibling (0 if none)
+    u64 cycles;  // self cycles
+    u64 calls;
+  };
+  Node* nodes = nullptr;
+  uint nodes_len = 0;
+  uint nodes_cap = 0;
+
+  // Shadow call stack
+  struct Frame {
+    u32 node;
+    u8  sp; // stack pointer when the frame was entered
+  } stack [MAX_DEPTH];
+  uint depth = 0;
+  u32 node = 0; // current node
+
+  u64 total = 0; // total cycles recorded
+
+  void grow_pcs(u32 key);
+  u32 child(u32 parent, u32 key);
+  void unwind(u8 sp);
+
+  void label(u32 key, char* buf) const;
+  void write_stack(FILE* f, u32 node) const;
+
+public:
+  ~CPU_Profiler();
+  CPU_Profiler();
+
+  CPU_Profiler(const CPU_Profiler&) = delete;
+  CPU_Profiler& operator=(const CPU_Profiler&) = delete;
+
+  void clear();
+
+  // Executed an instruction
+  void instr(u32 key, u16 addr, uint cycles) {
+    if (key >= this->pcs_len) this->grow_pcs(key);
+    PC& pc = this->pcs[key];
+    pc.cycles += cycles;
+    pc.count++;
+    pc.addr = addr;
+    this->nodes[this->node].cycles += cycles;
+    this->total += cycles;
+  }
+
+  // Entered a subroutine / interrupt handler (sp = stack pointer before the
+  // return address was pushed). `cycles` are charged to the new frame.
+  void call(u32 key, u8 sp, uint cycles = 0);
+  // Returned from a subroutine / interrupt handler (sp = stack pointer after
+  // the return address was pulled)
+  void ret(u8 sp) { this->unwind(sp); }
+  // Back at the top level (i.e: after a RESET)
+  void reset_stack() { this->depth = 0; this->node = 0; }
+
+  // Human-readable report of the hottest instructions (by cycles), followed by
+  // the hottest subroutines (by cycles, incl. the subroutines they call).
+  void write_report(FILE* f, uint max_rows = 50) const;
+  // One line per call stack, in the "folded stacks" format read by
+  // flamegraph.pl / speedscope / inferno (eg: `main;0F:C123;0F:C456 1234`)
+  void write_folded(FILE* f) const;
+};
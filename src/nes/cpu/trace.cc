@@ -0,0 +1,109 @@
+#include "trace.h"
+#include "instructions.h"
+
+#include <cstdio>
+
+// Reproduces the nestest "golden" log format, byte for byte
+void CPU_TraceEntry::to_nestest(char* buf) const {
+  using namespace Instructions;
+
+  const Opcode& opcode = Opcodes[this->op];
+
+  // create buffer for instruction operands
+  char instr_buf [64];
+  char bytes_buf [8];
+
+  { // open a new scope to use AddrM namespace
+  using namespace Instructions::AddrM;
+
+  u8  arg8  = this->arg[0];
+  u16 arg16 = this->arg[0] | (this->arg[1] << 8);
+
+  // Operand bytes
+  switch(opcode.addrm) {
+    case abs_:
+    case absX:
+    case absY:
+    case ind_:
+      sprintf(bytes_buf, "%02X %02X", arg8, this->arg[1]);
+      break;
+    case indY:
+    case Xind:
+    case zpg_:
+    case zpgX:
+    case zpgY:
+    case rel :
+    case imm :
+      sprintf(bytes_buf, "%02X   ", arg8);
+      break;
+    default:
+      sprintf(bytes_buf, "     ");
+      break;
+  }
+
+  // Specific instrucion operands for each addressing mode
+  switch(opcode.addrm) {
+  case abs_: sprintf(instr_buf, "$%04X = %02X",
+              arg16, this->val
+            ); break;
+  case absX: sprintf(instr_buf, "$%04X,X @ %04X = %02X",
+              arg16, u16(arg16 + this->x), this->val
+            ); break;
+  case absY: sprintf(instr_buf, "$%04X,Y @ %04X = %02X",
+              arg16, u16(arg16 + this->y), this->val
+            ); break;
+  case indY: sprintf(instr_buf, "($%02X),Y = %04X @ %04X = %02X",
+              arg8, this->ptr, u16(this->ptr + this->y), this->val
+            ); break;
+  case Xind: sprintf(instr_buf, "($%02X,X) @ %02X = %04X = %02X",
+              arg8, u8(this->x + arg8), this->ptr, this->val
+            ); break;
+  case ind_: sprintf(instr_buf, "($%04X) = %04X",
+              arg16, this->ptr
+            ); break;
+  case zpg_: sprintf(instr_buf, "$%02X = %02X",
+              arg8, this->val
+            ); break;
+  case zpgX: sprintf(instr_buf, "$%02X,X @ %02X = %02X",
+              arg8, u8(arg8 + this->x), this->val
+            ); break;
+  case zpgY: sprintf(instr_buf, "$%02X,Y @ %02X = %02X",
+              arg8, u8(arg8 + this->y), this->val
+            ); break;
+  case rel : sprintf(instr_buf, "$%04X", this->pc + 2 + i8(arg8));        break;
+  case imm : sprintf(instr_buf, "#$%02X", arg8);                          break;
+  default: sprintf(instr_buf, " "); break;
+  }
+
+  // handle a few edge cases
+  switch (opcode.instr) {
+    case Instr::JMP:
+    case Instr::JSR:
+      if (opcode.addrm == abs_)
+        sprintf(instr_buf, "$%04X", arg16);
+      break;
+    case Instr::LSR:
+    case Instr::ASL:
+    case Instr::ROR:
+    case Instr::ROL:
+      if (opcode.addrm == acc)
+        sprintf(instr_buf, "A");
+      break;
+    default: break;
+  }
+
+  } // close AddrM scope
+
+  snprintf(buf, NESTEST_LEN,
+    "%04X  %02X %s  %s %-28s"
+    "A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%3u",
+    this->pc, this->op, bytes_buf, opcode.instr_name, instr_buf,
+    this->a,
+    this->x,
+    this->y,
+    this->p & ~0x10, // 0b11101111, match nestest "golden" log
+    this->s,
+    (this->cycles - 7) * 3 % 341 // CYC measures PPU X coordinates
+                                 // (PPU runs 3x as fast as CPU)
+  );
+}
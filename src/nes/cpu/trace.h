@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+
+#include "common/util.h"
+
+// Binary CPU trace
+// A fixed-size record of CPU state, taken right before executing an
+// instruction. Recording one is a lot cheaper than formatting it, so the
+// formatting (into the nestest log format) is left for later / offline.
+struct CPU_TraceEntry {
+  u32 cycles;   // CPU cycles elapsed
+  u16 pc;
+  u16 scanline; // PPU position
+  u16 dot;
+  u16 ptr;      // pointer read by the indirect addressing modes
+  u8  op;
+  u8  arg [2];  // bytes following the opcode (whether it uses them or not)
+  u8  val;      // value at the effective address
+  u8  a, x, y, p, s;
+
+  // Formats the entry as a line of the nestest golden log (without a newline).
+  // buf must hold at least NESTEST_LEN bytes.
+  static constexpr uint NESTEST_LEN = 128;
+  void to_nestest(char* buf) const;
+};
+
+static_assert(sizeof(CPU_TraceEntry) == 24, "CPU_TraceEntry should be packed");
+
+// Trace files are this header, followed by raw CPU_TraceEntry's (in the
+// host's byte order)
+struct CPU_TraceFileHeader {
+  char magic [8]; // "ANESECPU"
+  u32 version;
+  u32 entry_size; // sizeof(CPU_TraceEntry)
+
+  static constexpr u32 VERSION = 1;
+};
+
+// Ring of the last N traced instructions.
+// Lock-free for a single writer (the CPU) and a single reader (eg: a thread
+// draining it to a file). Old entries get overwritten, so a reader that falls
+// too far behind loses entries (which it can detect with written()).
+class CPU_TraceRing final {
+private:
+  CPU_TraceEntry* entries;
+  uint mask;
+  std::atomic<u64> len { 0 }; // total # of entries ever pushed
+
+public:
+  ~CPU_TraceRing() { delete[] this->entries; }
+  CPU_TraceRing(uint size_log2 = 16)
+  : entries(new CPU_TraceEntry [1 << size_log2])
+  , mask((1 << size_log2) - 1)
+  {}
+
+  CPU_TraceRing(const CPU_TraceRing&) = delete;
+  CPU_TraceRing& operator=(const CPU_TraceRing&) = delete;
+
+  uint size() const { return this->mask + 1; }
+  u64 written() const { return this->len.load(std::memory_order_acquire); }
+
+  // Entry i is only valid while written() - i <= size()
+  const CPU_TraceEntry& operator[](u64 i) const {
+    return this->entries[i & this->mask];
+  }
+
+  const CPU_TraceEntry& newest() const { return (*this)[this->written() - 1]; }
+
+  void push(const CPU_TraceEntry& entry) {
+    const u64 len = this->len.load(std::memory_order_relaxed);
+    this->entries[len & this->mask] = entry;
+    this->len.store(len + 1, std::memory_order_release);
+  }
+
+  // PPU position, stamped onto pushed entries (set by the NES)
+  u16 scanline = 0;
+  u16 dot = 0;
+};
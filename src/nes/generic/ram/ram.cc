@@ -3,7 +3,11 @@
 #include <cassert>
 #include <cstdio>
 
-RAM::RAM(uint ram_size, const char* label /* = "?" */) {
+RAM::RAM(uint ram_size, const char* label /* = "?" */)
+: RAM(ram_size, nullptr, label)
+{}
+
+RAM::RAM(uint ram_size, u8* storage, const char* label /* = "?" */) {
   this->label = label;
 
   // Don't allocate more memory than addressable by a u16
@@ -12,7 +16,8 @@ RAM::RAM(uint ram_size, const char* label /* = "?" */) {
   }
 
   this->size = ram_size;
-  this->ram = new u8 [ram_size];
+  this->owns_ram = (storage == nullptr);
+  this->ram = storage ? storage : new u8 [ram_size];
 
   // Init RAM
   for (uint addr = 0; addr < this->size; addr++)
@@ -20,7 +25,8 @@ RAM::RAM(uint ram_size, const char* label /* = "?" */) {
 }
 
 RAM::~RAM() {
-  delete[] this->ram;
+  if (this->owns_ram)
+    delete[] this->ram;
 }
 
 // RAM has no side-effects
@@ -48,10 +54,12 @@ void RAM::write(u16 addr, u8 val) {
     assert(false);
   }
   this->ram[addr] = val;
+  this->dirty.mark(addr);
 }
 
 void RAM::clear() {
   // Reset RAM to default values
   for (uint addr = 0; addr < this->size; addr++)
     this->ram[addr] = 0x00;
+  this->dirty.mark_all();
 }
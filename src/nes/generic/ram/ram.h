@@ -11,18 +11,28 @@ class RAM final : public Memory, public Serializable {
 private:
   u8*  ram;
   uint size;
+  bool owns_ram;
 
   const char* label;
 
+  // Which 256 byte pages have been written to (see Serializable::Layout)
+  Serializable::DirtyPages dirty;
+
   SERIALIZE_START(2, "RAM")
     SERIALIZE_POD(size)
-    SERIALIZE_ARRAY_VARIABLE(ram, size)
+    SERIALIZE_ARRAY_VARIABLE_DIRTY(ram, size, dirty)
   SERIALIZE_END(2)
 
+  // whatever got loaded might not match any earlier snapshot
+  virtual void state_loaded() override { this->dirty.mark_all(); }
+
 public:
   ~RAM();
   RAM() = delete;
   RAM(uint ram_size, const char* label = "?");
+  // Uses caller-owned memory (at least ram_size bytes) as backing storage,
+  // instead of allocating its own. Handy for keeping RAM inline.
+  RAM(uint ram_size, u8* storage, const char* label = "?");
 
   // <Memory>
   u8 read(u16 addr)       override;
@@ -25,4 +25,7 @@ public:
 
   // Also provide a const read method (for when there is a `const ROM` type)
   u8 read(u16 addr) const;
+
+  // Direct access to underlying memory (no bounds checking!)
+  const u8* data() const { return this->rom; }
 };
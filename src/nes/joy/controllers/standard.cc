@@ -32,7 +32,11 @@ u8 JOY_Standard::peek(u16 addr) const {
 void JOY_Standard::write(u16 addr, u8 val) {
   (void) addr;
 
-  this->strobe = val & 0x01;
+  const bool strobe = val & 0x01;
+  if (this->strobe && !strobe)
+    this->_callbacks.poll.run(this);
+
+  this->strobe = strobe;
   this->curr_btn = 0x01;
 }
 
@@ -3,6 +3,7 @@
 #include "common/util.h"
 #include "nes/interfaces/memory.h"
 
+#include "common/callback_manager.h"
 #include "common/serializable.h"
 
 namespace JOY_Standard_Button {
@@ -44,4 +45,12 @@ public:
 
   void set_button(JOY_Standard_Button::Type btn, bool active);
   bool get_button(JOY_Standard_Button::Type btn) const;
+
+  struct {
+    // The game just latched the buttons (i.e: it stopped strobing $4016), so
+    // this is the latest the buttons can be set before it reads them out.
+    // Lets frontends sample input right when the game asks for it, instead of
+    // once per frame (see --late-input in the SDL frontend).
+    CallbackManager<JOY_Standard*> poll;
+  } _callbacks;
 };
@@ -2,13 +2,15 @@
 
 #include <cstdio>
 
+#include "common/trace.h"
+
 // The constructor creates the individual NES components, and "wires them up"
 // to one antother.
 NES::NES(const NES_Params& params) :
 // RAM Modules
-cpu_wram(0x800, "WRAM"),
-ppu_vram(0x800, "CIRAM"),
-ppu_pram(32, "Palette"),
+cpu_wram(0x800, this->ram.cpu_wram, "WRAM"),
+ppu_vram(0x800, this->ram.ppu_vram, "CIRAM"),
+ppu_pram(32,    this->ram.ppu_pram, "Palette"),
 // Processors
 // (techincally UB since we pass references to objects that have not been
 // initialized yet...)
@@ -36,6 +38,51 @@ interrupts(),
 params(params)
 {}
 
+NES::~NES() {
+  if (this->owns_cart)
+    delete this->cart;
+  delete this->layout;
+}
+
+NES* NES::clone() const {
+  NES* nes = new NES (this->params);
+  if (this->cart) {
+    nes->loadCartridge(this->cart->clone());
+    nes->owns_cart = true;
+  }
+  nes->copy_state(*this);
+  nes->updated_params();
+  return nes;
+}
+
+Serializable::Layout& NES::state_layout() const {
+  if (!this->layout)
+    this->layout = new Serializable::Layout (*const_cast<NES*>(this));
+  return *this->layout;
+}
+
+uint NES::state_size() const {
+  return this->state_layout().state_size();
+}
+
+u32 NES::save_state(u8* buf) const {
+  const u32 sync = this->state_layout().save(buf);
+  _callbacks.savestate_created.run();
+  return sync;
+}
+
+uint NES::save_state_incremental(u8* buf, u32& sync) const {
+  const uint copied = this->state_layout().save_incremental(buf, sync);
+  _callbacks.savestate_created.run();
+  return copied;
+}
+
+u32 NES::load_state(const u8* buf) {
+  const u32 sync = this->state_layout().load(buf);
+  _callbacks.savestate_loaded.run();
+  return sync;
+}
+
 void NES::updated_params() {
   this->apu.set_speed(this->params.speed / 100.0);
 }
@@ -44,12 +91,23 @@ bool NES::loadCartridge(Mapper* cart) {
   if (cart == nullptr)
     return false;
 
+  if (this->owns_cart)
+    delete this->cart;
+  this->owns_cart = false;
+
   this->cart = cart;
   this->cart->set_interrupt_line(&this->interrupts);
 
+  delete this->layout;
+  this->layout = nullptr;
+
   this->cpu_mmu.loadCartridge(this->cart);
   this->ppu_mmu.loadCartridge(this->cart);
 
+  // CPU profiles are keyed by PRG ROM offsets, which only make sense per-cart
+  if (this->params.profile_cpu)
+    this->cpu._profiler().clear();
+
   _callbacks.cart_changed.run(this->cart);
 
   return true;
@@ -58,8 +116,14 @@ bool NES::loadCartridge(Mapper* cart) {
 void NES::removeCartridge() {
   if (this->cart)
     this->cart->set_interrupt_line(nullptr);
+  if (this->owns_cart)
+    delete this->cart;
+  this->owns_cart = false;
   this->cart = nullptr;
 
+  delete this->layout;
+  this->layout = nullptr;
+
   this->cpu_mmu.removeCartridge();
   this->ppu_mmu.removeCartridge();
 
@@ -118,9 +182,25 @@ void NES::reset() {
 void NES::cycle() {
   if (this->is_running == false) return;
 
+  // Every so often, time how long each subsystem takes
+  const bool profile = this->params.profile
+    && this->counters.steps++ % NES_Stats::PROFILE_INTERVAL == 0;
+  u64 t_cpu = 0, t_apu = 0, t_ppu = 0;
+
+  if (profile) t_cpu = NES_Stats::timestamp();
+
+  // Stamp the PPU's position onto traced instructions
+  if (this->params.log_cpu) {
+    CPU_TraceRing& trace = this->cpu._trace();
+    trace.scanline = this->ppu._scanline();
+    trace.dot      = this->ppu._scancycle();
+  }
+
   // Execute a CPU instruction
   uint cpu_cycles = this->cpu.step();
 
+  if (profile) t_apu = NES_Stats::timestamp();
+
   // Run APU 1x per cpu_cycle
   for (uint i = 0; i < cpu_cycles; i++)
     this->apu.cycle();
@@ -128,18 +208,32 @@ void NES::cycle() {
   if (this->apu.stall_cpu())
     cpu_cycles += 4; // not entirely accurate... depends on other factors
 
+  if (profile) t_ppu = NES_Stats::timestamp();
+
   // Run PPU + Cartridge 3x per cpu_cycle
   for (uint i = 0; i < cpu_cycles * 3; i++) {
     this->ppu.cycle();
     this->cart->cycle();
   }
 
+  this->counters.cpu_cycles += cpu_cycles;
+  this->counters.ppu_dots   += cpu_cycles * 3;
+
+  if (profile) {
+    const u64 t_end = NES_Stats::timestamp();
+    const uint n = NES_Stats::PROFILE_INTERVAL;
+    this->counters.ticks.cpu += (t_apu - t_cpu) * n;
+    this->counters.ticks.apu += (t_ppu - t_apu) * n;
+    this->counters.ticks.ppu += (t_end - t_ppu) * n;
+  }
+
   if (!this->cpu.isRunning())
     this->is_running = false;
 }
 
 void NES::step_frame() {
   if (this->is_running == false) return;
+  TRACE_SCOPE("NES::step_frame");
 
   const uint curr_frame = this->ppu.getNumFrames();
   while (this->is_running && this->ppu.getNumFrames() == curr_frame) {
@@ -147,6 +241,25 @@ void NES::step_frame() {
   }
 }
 
+// Runs a frame in the PPU's frameskip mode.
+// NOTE: the NES steps an entire CPU instruction at a time, so the first few
+// dots of the next frame are also skipped (they are in the overscan anyways)
+void NES::skip_frame() {
+  TRACE_SCOPE("NES::skip_frame");
+  this->ppu.set_skip_render(true);
+  this->step_frame();
+  this->ppu.set_skip_render(false);
+}
+
+// Cheapest way to run a frame that nobody will see or hear (eg: re-simulating
+// frames during a rollback). The audio would just get played a second time.
+void NES::resim_frame() {
+  TRACE_SCOPE("NES::resim_frame");
+  this->apu.set_muted(true);
+  this->skip_frame();
+  this->apu.set_muted(false);
+}
+
 void NES::getFramebuff(const u8** framebuffer) const {
   this->ppu.getFramebuff(framebuffer);
 }
@@ -154,3 +267,26 @@ void NES::getFramebuff(const u8** framebuffer) const {
 void NES::getAudiobuff(float** samples, uint* len) {
   this->apu.getAudiobuff(samples, len);
 }
+
+NES_Stats NES::stats() const {
+  NES_Stats stats;
+
+  stats.frames      = this->ppu.getNumFrames();
+  stats.cpu_instrs  = this->cpu._stats.instrs;
+  stats.cpu_cycles  = this->counters.cpu_cycles;
+  stats.ppu_dots    = this->counters.ppu_dots;
+  stats.apu_samples = this->apu._stats.samples;
+
+  for (uint i = 0; i < NES_Stats::BUS_REGIONS; i++) {
+    stats.bus_reads[i]  = this->cpu_mmu._stats.reads[i];
+    stats.bus_writes[i] = this->cpu_mmu._stats.writes[i];
+  }
+
+  stats.bank_switches = this->cart ? this->cart->_stats.bank_switches : 0;
+  stats.irqs = this->cpu._stats.irqs;
+  stats.nmis = this->cpu._stats.nmis;
+
+  stats.ticks = this->counters.ticks;
+
+  return stats;
+}
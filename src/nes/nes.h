@@ -15,6 +15,7 @@
 #include "wiring/ppu_mmu.h"
 
 #include "params.h"
+#include "stats.h"
 
 // Core NES class.
 // - Owns all NES core resources (but NOT the cartridge or joypads)
@@ -30,8 +31,17 @@ private:
   // I.e: Things not present on the NES mainboard
 
   Mapper* cart = nullptr; // Game Cartridge
+  bool owns_cart = false;  // only true for clones (see NES::clone)
 
   /*----------  Chips  ----------*/
+  // Backing memory for the RAM chips, kept inline (and contiguous), instead of
+  // being scattered across the heap
+  struct {
+    u8 cpu_wram [0x800];
+    u8 ppu_vram [0x800];
+    u8 ppu_pram [32];
+  } ram;
+
   RAM cpu_wram; // 2k CPU general purpose Work RAM
   RAM ppu_vram; // 2k PPU nametable VRAM
   RAM ppu_pram; // 32 bytes PPU palette RAM
@@ -61,6 +71,15 @@ private:
 
   bool is_running = false;
 
+  // Emulation counters that don't belong to any one component (not part of
+  // the savestate, see NES_Stats)
+  struct {
+    u64 cpu_cycles = 0;
+    u64 ppu_dots = 0;
+    uint steps = 0; // for sampling NES_Stats::ticks
+    NES_Stats::Ticks ticks {};
+  } counters;
+
   SERIALIZE_START(10, "NES")
     SERIALIZE_POD(is_running)
     SERIALIZE_SERIALIZABLE_PTR(cart)
@@ -87,10 +106,41 @@ public:
   }
 private:
   const NES_Params& params;
+
+  // Flat savestate layout (built on demand, rebuilt when the cart changes)
+  mutable Serializable::Layout* layout = nullptr;
+  Serializable::Layout& state_layout() const;
 public:
+  ~NES();
   NES(const NES_Params& new_params);
   void updated_params();
 
+  // Creates an independent NES with identical emulation state, without going
+  // through a serialize / deserialize round-trip.
+  // - The clone gets its own copy of the cartridge (sharing the ROM data, so
+  //   the original Cartridge must outlive the clone), which it owns.
+  // - Joypads and callbacks are _not_ carried over, and the framebuffers stay
+  //   blank until the clone renders a frame of its own.
+  NES* clone() const;
+
+  // Flat savestates (see Serializable::Layout)
+  // A whole lot faster than serialize / deserialize, since the state is just a
+  // fixed-size blob (state_size() bytes), copied to / from its original spots
+  // in memory. Blobs are interchangeable between NESs running the same ROM.
+  uint state_size() const;
+  // Both return a sync token for buf (only needed for save_state_incremental)
+  u32 save_state(u8* buf) const;
+  u32 load_state(const u8* buf);
+  // Same as save_state, but when `sync` is the token from buf's last save /
+  // load, only the RAM pages that were written to since then are copied. Each
+  // buffer keeps its own token, and tokens stay good for the last
+  // Serializable::Layout::HISTORY saves / loads, so rings of up to that many
+  // slots (eg: rewind, run-ahead, rollback) stay incremental. Pass 0 to force a
+  // full save (eg: after reallocating buf). RAM writes are only tracked once
+  // this has been called. `sync` gets updated to buf's new token. Returns the
+  // # of bytes copied.
+  uint save_state_incremental(u8* buf, u32& sync) const;
+
   /*-----------  Key Operation Functions  ------------*/
 
   bool loadCartridge(Mapper* cart);
@@ -104,6 +154,8 @@ public:
 
   void cycle();      // Run a single clock cycle
   void step_frame(); // Cycle the NES until there is a new frame to display
+  void skip_frame(); // Same as step_frame, but without rendering the frame
+  void resim_frame(); // Same as skip_frame, but without any audio either
 
   void getFramebuff(const u8** framebuffer) const;
   void getAudiobuff(float** samples, uint* len);
@@ -116,6 +168,12 @@ public:
   CPU& _cpu() { return this->cpu; }
   PPU& _ppu() { return this->ppu; }
 
+  CPU_MMU& _cpu_mmu() { return this->cpu_mmu; }
+  const CPU_MMU& _cpu_mmu() const { return this->cpu_mmu; }
+
+  // Snapshot of the emulation counters (see NES_Stats)
+  NES_Stats stats() const;
+
   struct {
     CallbackManager<Mapper*> cart_changed;
     CallbackManager<> savestate_created;
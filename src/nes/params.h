@@ -7,4 +7,13 @@ struct NES_Params {
   uint speed;           // in %
   bool log_cpu;
   bool ppu_timing_hack;
+  // Compact mode - for running _lots_ of instances at once.
+  // The PPU doesn't allocate any framebuffers of its own (it only renders into
+  // targets set via PPU::setFramebuffTarget / setFramebuffNESColorTarget), and
+  // the APU doesn't generate any audio.
+  bool compact;
+  // Time each subsystem (see NES_Stats::ticks)
+  bool profile;
+  // Count cycles per instruction / subroutine (see CPU_Profiler)
+  bool profile_cpu;
 };
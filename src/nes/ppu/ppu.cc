@@ -6,20 +6,37 @@
 
 PPU::PPU(
   const NES_Params& params,
-  Memory& mem,
+  PPU_MMU& mem,
   DMA& dma,
   InterruptLines& interrupts
 ) :
   dma(dma),
   interrupts(interrupts),
   mem(mem),
-  oam(256, "OAM"),
-  oam2(32, "Secondary OAM"),
+  oam(256, this->oam_ram.oam, "OAM"),
+  oam2(32, this->oam_ram.oam2, "Secondary OAM"),
   fogleman_nmi_hack(params.ppu_timing_hack)
 {
+  if (params.compact) {
+    this->bufs = nullptr;
+    this->fb.target    = nullptr;
+    this->fb.front     = nullptr;
+    this->fb.nes_color = nullptr;
+  } else {
+    this->bufs = new Framebuffers ();
+    this->fb.target    = this->bufs->framebuffer[0];
+    this->fb.front     = this->bufs->framebuffer[1];
+    this->fb.nes_color = this->bufs->framebuffer_nes_color;
+  }
+  this->fb.is_external = false;
+
   this->power_cycle();
 }
 
+PPU::~PPU() {
+  delete this->bufs;
+}
+
 void PPU::power_cycle() {
   this->cycles = 0;
   this->frames = 0;
@@ -29,8 +46,12 @@ void PPU::power_cycle() {
 
   this->cpu_data_bus = 0x00;
 
+  this->frameskip = false;
+  this->update_skip_render();
+
   memset(&this->bgr, 0, sizeof this->bgr);
   memset(&this->spr, 0, sizeof this->spr);
+  memset(&this->spr_line, 0, sizeof this->spr_line);
 
   // http://wiki.nesdev.com/w/index.php/PPU_power_up_state
   memset(&this->reg, 0, sizeof this->reg);
@@ -81,13 +102,50 @@ void PPU::nmiChange() { // hack
 
 uint PPU::getNumFrames() const { return this->frames; }
 
-void PPU::getFramebuff   (const u8** fb) const { if (fb) *fb = this->framebuffer;     }
-void PPU::getFramebuffSpr(const u8** fb) const { if (fb) *fb = this->framebuffer_spr; }
-void PPU::getFramebuffBgr(const u8** fb) const { if (fb) *fb = this->framebuffer_bgr; }
+void PPU::getFramebuff   (const u8** fb) const { if (fb) *fb = this->fb.front; }
+void PPU::getFramebuffSpr(const u8** fb) const { if (fb) *fb = this->bufs ? this->bufs->framebuffer_spr : nullptr; }
+void PPU::getFramebuffBgr(const u8** fb) const { if (fb) *fb = this->bufs ? this->bufs->framebuffer_bgr : nullptr; }
+
+void PPU::getFramebuffNESColor   (const u8** fb) const { if (fb) *fb = this->fb.nes_color; }
+void PPU::getFramebuffNESColorSpr(const u8** fb) const { if (fb) *fb = this->bufs ? this->bufs->framebuffer_nes_color_spr : nullptr; }
+void PPU::getFramebuffNESColorBgr(const u8** fb) const { if (fb) *fb = this->bufs ? this->bufs->framebuffer_nes_color_bgr : nullptr; }
+
+// Returns whichever internal RGBA framebuffer isn't at the front
+// (or nullptr, in compact mode)
+#define back_framebuff() \
+  (!this->bufs ? nullptr \
+    : (this->fb.front == this->bufs->framebuffer[0]) \
+      ? this->bufs->framebuffer[1] \
+      : this->bufs->framebuffer[0])
+
+void PPU::setFramebuffTarget(u8* framebuffer) {
+  if (framebuffer) {
+    this->fb.target = framebuffer;
+    this->fb.is_external = true;
+  } else {
+    this->fb.target = back_framebuff();
+    this->fb.is_external = false;
+  }
+  this->update_skip_render();
+}
 
-void PPU::getFramebuffNESColor   (const u8** fb) const { if (fb) *fb = this->framebuffer_nes_color;     }
-void PPU::getFramebuffNESColorSpr(const u8** fb) const { if (fb) *fb = this->framebuffer_nes_color_spr; }
-void PPU::getFramebuffNESColorBgr(const u8** fb) const { if (fb) *fb = this->framebuffer_nes_color_bgr; }
+void PPU::setFramebuffNESColorTarget(u8* framebuffer) {
+  if (framebuffer)
+    this->fb.nes_color = framebuffer;
+  else
+    this->fb.nes_color = this->bufs ? this->bufs->framebuffer_nes_color : nullptr;
+  this->update_skip_render();
+}
+
+void PPU::swap_framebuff() {
+  this->fb.front = this->fb.target;
+  if (!this->fb.is_external)
+    this->fb.target = back_framebuff();
+
+  _callbacks.frame_ready.run();
+}
+
+#undef back_framebuff
 
 /*----------------------------  Memory Interface  ----------------------------*/
 
@@ -576,6 +634,10 @@ PPU::Pixel PPU::get_bgr_pixel() {
   if (this->reg.ppumask.b == false || this->scan.line >= 240)
     return Pixel();
 
+  // Sprite 0 hit only cares if the pixel is on, not what color it is
+  if (this->skip_render)
+    return Pixel { pixel_type != 0, 0, 0 };
+
   return Pixel {
     pixel_type != 0,
     this->mem[0x3F00 + palette * 4 + pixel_type],
@@ -585,15 +647,13 @@ PPU::Pixel PPU::get_bgr_pixel() {
 
 // TODO: make this more "hardware" accurate.
 // https://wiki.nesdev.com/w/index.php/PPU_rendering
-PPU::Pixel PPU::get_spr_pixel(PPU::Pixel& bgr_pixel) {
-  const int x = this->scan.cycle - 2;
-
-  if (
-    this->reg.ppumask.s == false || // Is sprite rendering is disabled
-    (!this->reg.ppumask.M && x < 8) // Is sprite mask enabled + in range of it?
-  ) return Pixel();
+//
+// Instead of scanning through OAM2 on every single dot, all 8 sprites are
+// rendered into a scanline-sized buffer once per scanline (right after sprite
+// evaluation), leaving get_spr_pixel with a single lookup.
+void PPU::build_spr_line() {
+  memset(this->spr_line, 0, sizeof this->spr_line);
 
-  // Scan through OAM2 to see if there is a sprite to draw at this scan.cycle
   for (uint sprite = 0; sprite < 8; sprite++) {
     // Read sprite data
     u8 y_pos      = this->oam2[sprite * 4 + 0];
@@ -617,23 +677,15 @@ PPU::Pixel PPU::get_spr_pixel(PPU::Pixel& bgr_pixel) {
       0xFF == attributes.val
     ) break;
 
-    // Does this sprite have a pixel at the current x addr?
-    bool x_in_range = in_range(int(x_pos), int(x) - 7, int(x));
-    if (!x_in_range)
-      continue;
-
-    // Cool! There is a sprite here!
+    // When skipping frames, only sprite 0 matters (for sprite 0 hit)
+    if (this->skip_render && sprite != 0)
+      break;
 
-    // Now we just need to get the actual pixel data for this sprite...
-    // First, which pixel of the sprite are we rendering?
+    // Which row of the sprite are we rendering?
     uint spr_row = this->scan.line - y_pos - 1;
-    uint spr_col = 7 - (x - x_pos);
 
     const uint sprite_height = this->reg.ppuctrl.H ? 16 : 8;
-    if (attributes.flip_vertical)   spr_row = sprite_height - 1 - spr_row;
-    if (attributes.flip_horizontal) spr_col =             8 - 1 - spr_col;
-
-    // Time to get the pixel type yo!
+    if (attributes.flip_vertical) spr_row = sprite_height - 1 - spr_row;
 
     // NOTE: I completely overlooked handling 8x16 sprites for a very long
     //       time. I did manage to figure it out though!
@@ -653,36 +705,63 @@ PPU::Pixel PPU::get_spr_pixel(PPU::Pixel& bgr_pixel) {
       }
     }
 
+    // Horizontal flipping is handled by the CHR cache
     u16 tile_addr = (0x1000 * sprite_table) + (tile_index * 16) + spr_row;
-    u8 lo_bp = this->mem.peek(tile_addr + 0);
-    u8 hi_bp = this->mem.peek(tile_addr + 8);
-    u8 pixel_type = nth_bit(lo_bp, spr_col) + (nth_bit(hi_bp, spr_col) << 1);
+    const u8* row = this->mem.chr_tile_row(tile_addr, attributes.flip_horizontal);
 
-    // If the pixel is transparent, continue looking for a sprite to render...
-    if (pixel_type == 0)
-      continue;
+    for (uint spr_col = 0; spr_col < 8 && x_pos + spr_col < 256; spr_col++) {
+      auto& px = this->spr_line[x_pos + spr_col];
+      // Lower sprite-slots have priority, so don't overwrite opaque pixels.
+      // Transparent pixels let the sprites behind them through.
+      if (px.pixel_type != 0 || row[spr_col] == 0)
+        continue;
 
-    // The rules for Sprite0 hit are fairly involved...
-    // You can only get a sprite 0 hit when:
-    if (
-      sprite == 0 &&                    // This is sprite-slot 0
-      this->spr.spr_zero_on_line &&     // And Sprite 0 is on the line
-      this->reg.ppumask.is_rendering && // And rendering is enabled
-      this->reg.ppustatus.S == 0 &&     // And there has not been a spr hit
-      (x_pos != 0xFF && x < 0xFF) &&    // And not when dot/spr is at 255
-      bgr_pixel.is_on                   // And the bgr pixel is on
-    ) this->reg.ppustatus.S = 1; // Only then does sprite hit occur
-
-    // Otherwise, fetch which pallete color to use, and return the pixel!
-    return Pixel {
-      true,
-      this->mem.peek(0x3F10 + attributes.palette * 4 + pixel_type),
-      bool(attributes.priority)
-    };
+      px.pixel_type = row[spr_col];
+      px.palette    = attributes.palette;
+      px.priority   = attributes.priority;
+      px.spr_zero   = sprite == 0;
+    }
   }
+}
+
+PPU::Pixel PPU::get_spr_pixel(PPU::Pixel& bgr_pixel) {
+  const int x = this->scan.cycle - 2;
+
+  if (
+    this->reg.ppumask.s == false || // Is sprite rendering is disabled
+    (!this->reg.ppumask.M && x < 8) // Is sprite mask enabled + in range of it?
+  ) return Pixel();
+
+  // Sprites are only ever drawn on-screen
+  if (x < 0 || x > 255 || this->scan.line >= 240)
+    return Pixel();
+
+  const auto& px = this->spr_line[x];
 
-  // if nothing was found, return a empty pixel
-  return Pixel();
+  // If the pixel is transparent, there is no sprite to draw here
+  if (px.pixel_type == 0)
+    return Pixel();
+
+  // The rules for Sprite0 hit are fairly involved...
+  // You can only get a sprite 0 hit when:
+  if (
+    px.spr_zero &&                    // This is sprite-slot 0
+    this->spr.spr_zero_on_line &&     // And Sprite 0 is on the line
+    this->reg.ppumask.is_rendering && // And rendering is enabled
+    this->reg.ppustatus.S == 0 &&     // And there has not been a spr hit
+    x < 0xFF &&                       // And not when dot/spr is at 255
+    bgr_pixel.is_on                   // And the bgr pixel is on
+  ) this->reg.ppustatus.S = 1; // Only then does sprite hit occur
+
+  if (this->skip_render)
+    return Pixel { true, 0, px.priority };
+
+  // Otherwise, fetch which pallete color to use, and return the pixel!
+  return Pixel {
+    true,
+    this->mem.peek(0x3F10 + px.palette * 4 + px.pixel_type),
+    px.priority
+  };
 }
 
 /*----------------------------  Core Render Loop  ----------------------------*/
@@ -701,51 +780,66 @@ void PPU::cycle() {
       this->spr_fetch();
     }
 
-    // Priority Multiplexer decision table
-    // https://wiki.nesdev.com/w/index.php/PPU_rendering#Preface
-    // BG pixel | Sprite pixel | Priority | Output
-    // --------------------------------------------
-    // 0        | 0            | X        | BG ($3F00)
-    // 0        | 1-3          | X        | Sprite
-    // 1-3      | 0            | X        | BG
-    // 1-3      | 1-3          | 0        | Sprite
-    // 1-3      | 1-3          | 1        | BG
-
-    const bool bgr_on = bgr_pixel.is_on;
-    const bool spr_on = spr_pixel.is_on;
-
-    u8 nes_color = 0x00;
-    /**/ if (!bgr_on && !spr_on) nes_color = this->mem[0x3F00];
-    else if (!bgr_on &&  spr_on) nes_color = spr_pixel.nes_color;
-    else if ( bgr_on && !spr_on) nes_color = bgr_pixel.nes_color;
-    else if ( bgr_on &&  spr_on) nes_color = spr_pixel.priority
-                                              ? bgr_pixel.nes_color
-                                              : spr_pixel.nes_color;
-
-    u8 nes_color_bgr = bgr_on ? bgr_pixel.nes_color : this->mem.peek(0x3F00);
-    u8 nes_color_spr = spr_on ? spr_pixel.nes_color : this->mem.peek(0x3F00);
-
-    const uint x = (this->scan.cycle - 2);
-    const uint y = this->scan.line;
-
-    if (x < 256 && y != 261) {
-      framebuffer_nes_color    [y * 256 + x] = nes_color;
-      framebuffer_nes_color_bgr[y * 256 + x] = nes_color_bgr;
-      framebuffer_nes_color_spr[y * 256 + x] = nes_color_spr;
-
-      // raw NES colors are hard to render, so let's also do RGB translation.
-      // that way, we can directly pass the framebuffer to our rendering layer
-      const uint offset = (256 * 4 * y) + (4 * x);
-      #define draw_dot(buf, color) \
-        /* b */ buf[offset + 0] = color.b; \
-        /* g */ buf[offset + 1] = color.g; \
-        /* r */ buf[offset + 2] = color.r; \
-        /* a */ buf[offset + 3] = color.a;
-
-      draw_dot(framebuffer,     this->palette[nes_color     % 64]);
-      draw_dot(framebuffer_bgr, this->palette[nes_color_bgr % 64]);
-      draw_dot(framebuffer_spr, this->palette[nes_color_spr % 64]);
-      #undef draw_dot
+    if (this->scan.cycle == 0 && this->scan.line < 240)
+      this->build_spr_line();
+
+    // When skipping a frame, all that's left is composing the output pixel,
+    // which has no bearing on emulation, so it can be skipped entirely.
+    if (!this->skip_render) {
+      // Priority Multiplexer decision table
+      // https://wiki.nesdev.com/w/index.php/PPU_rendering#Preface
+      // BG pixel | Sprite pixel | Priority | Output
+      // --------------------------------------------
+      // 0        | 0            | X        | BG ($3F00)
+      // 0        | 1-3          | X        | Sprite
+      // 1-3      | 0            | X        | BG
+      // 1-3      | 1-3          | 0        | Sprite
+      // 1-3      | 1-3          | 1        | BG
+
+      const bool bgr_on = bgr_pixel.is_on;
+      const bool spr_on = spr_pixel.is_on;
+
+      u8 nes_color = 0x00;
+      /**/ if (!bgr_on && !spr_on) nes_color = this->mem[0x3F00];
+      else if (!bgr_on &&  spr_on) nes_color = spr_pixel.nes_color;
+      else if ( bgr_on && !spr_on) nes_color = bgr_pixel.nes_color;
+      else if ( bgr_on &&  spr_on) nes_color = spr_pixel.priority
+                                                ? bgr_pixel.nes_color
+                                                : spr_pixel.nes_color;
+
+      const uint x = (this->scan.cycle - 2);
+      const uint y = this->scan.line;
+
+      if (x < 256 && y != 261) {
+        if (this->fb.nes_color)
+          this->fb.nes_color[y * 256 + x] = nes_color;
+
+        // raw NES colors are hard to render, so let's also do RGB translation.
+        // that way, we can directly pass the framebuffer to our rendering layer
+        const uint offset = (256 * 4 * y) + (4 * x);
+        #define draw_dot(buf, color) \
+          /* b */ buf[offset + 0] = color.b; \
+          /* g */ buf[offset + 1] = color.g; \
+          /* r */ buf[offset + 2] = color.r; \
+          /* a */ buf[offset + 3] = color.a;
+
+        if (this->fb.target) {
+          draw_dot(this->fb.target, this->palette[nes_color % 64]);
+        }
+
+        // debug framebuffers (only when the PPU has its own buffers)
+        if (this->bufs) {
+          u8 nes_color_bgr = bgr_on ? bgr_pixel.nes_color : this->mem.peek(0x3F00);
+          u8 nes_color_spr = spr_on ? spr_pixel.nes_color : this->mem.peek(0x3F00);
+
+          this->bufs->framebuffer_nes_color_bgr[y * 256 + x] = nes_color_bgr;
+          this->bufs->framebuffer_nes_color_spr[y * 256 + x] = nes_color_spr;
+
+          draw_dot(this->bufs->framebuffer_bgr, this->palette[nes_color_bgr % 64]);
+          draw_dot(this->bufs->framebuffer_spr, this->palette[nes_color_spr % 64]);
+        }
+        #undef draw_dot
+      }
     }
   }
 
@@ -763,6 +857,10 @@ void PPU::cycle() {
   if (this->scan.cycle == 1) {
     // vblank start on line 241...
     if (this->scan.line == 241) {
+      // Skipped frames are never rendered, so there's nothing to swap in
+      if (!this->skip_render)
+        this->swap_framebuff();
+
       _callbacks.frame_end.run();
 
       // MAJOR KEY: The vblank flag is _always_ set!
@@ -10,6 +10,7 @@
 #include "dma.h"
 #include "nes/generic/ram/ram.h"
 #include "nes/wiring/interrupt_lines.h"
+#include "nes/wiring/ppu_mmu.h"
 
 #include "nes/params.h"
 
@@ -59,10 +60,15 @@ private:
   // ---- Core Hardware ---- //
 
   InterruptLines& interrupts;
-  Memory& mem; // PPU 16 bit address space (should be wired to ppu_mmu)
+  PPU_MMU& mem; // PPU 16 bit address space
 
   // ---- Sprite Hardware ---- //
 
+  struct {
+    u8 oam  [256];
+    u8 oam2 [32];
+  } oam_ram; // (backing memory for oam / oam2)
+
   RAM oam;  // Primary OAM - 256 bytes (Object Attribute Memory)
   RAM oam2; // Secondary OAM - 32 bytes (8 sprites to render on scanline)
 
@@ -77,6 +83,15 @@ private:
     bool spr_zero_on_line; // temp, not in hardware (just a workaround for now)
   } spr;
 
+  // Not in hardware either! Sprite pixels for the current scanline, rebuilt
+  // from OAM2 once per scanline (see build_spr_line)
+  struct {
+    u8   pixel_type; // 0 == transparent
+    u8   palette;
+    bool priority;
+    bool spr_zero;   // pixel belongs to sprite-slot 0
+  } spr_line [256];
+
   // ---- Background Hardware ---- //
 
   struct {
@@ -196,21 +211,37 @@ private:
   Pixel get_bgr_pixel();
   Pixel get_spr_pixel(Pixel& bgr_pixel);
 
+  void build_spr_line();
+
   void bgr_fetch();
   void spr_fetch();
 
   /*----  Emulation Vars and Methods  ----*/
 
-  // RGBA framebuffers - easily passed to rendering layer
-  u8 framebuffer     [256 * 4 * 240] = {0};
-  u8 framebuffer_spr [256 * 4 * 240] = {0};
-  u8 framebuffer_bgr [256 * 4 * 240] = {0};
+  // The PPU's own framebuffers (nullptr in compact mode)
+  struct Framebuffers {
+    // RGBA framebuffers - easily passed to rendering layer
+    u8 framebuffer     [2][256 * 4 * 240];
+    u8 framebuffer_spr [256 * 4 * 240];
+    u8 framebuffer_bgr [256 * 4 * 240];
+
+    // nes color framebuffers
+    u8 framebuffer_nes_color     [256 * 240];
+    u8 framebuffer_nes_color_bgr [256 * 240];
+    u8 framebuffer_nes_color_spr [256 * 240];
+  }* bufs;
+
+  // The main RGBA framebuffer is double-buffered: the PPU renders into the
+  // target, which gets swapped to the front at vblank.
+  struct {
+    u8*  target; // being rendered into
+    u8*  front;  // last finished frame (i.e: what getFramebuff returns)
+    bool is_external; // target is caller-owned memory
 
-  // nes color framebuffers
-  u8 framebuffer_nes_color     [256 * 240] = {0};
-  u8 framebuffer_nes_color_bgr [256 * 240] = {0};
-  u8 framebuffer_nes_color_spr [256 * 240] = {0};
+    u8*  nes_color; // nes color target (single-buffered)
+  } fb;
 
+  void swap_framebuff();
 
   // scanline tracker
   struct {
@@ -221,6 +252,12 @@ private:
   uint cycles; // total PPU cycles
   uint frames; // total frames rendered
 
+  bool frameskip;   // see set_skip_render
+  bool skip_render; // frameskip, or there's nothing to render into
+  void update_skip_render() {
+    this->skip_render = this->frameskip || (!this->fb.target && !this->fb.nes_color);
+  }
+
   SERIALIZE_START(9, "PPU")
     SERIALIZE_SERIALIZABLE(oam)
     SERIALIZE_SERIALIZABLE(oam2)
@@ -233,6 +270,11 @@ private:
     SERIALIZE_POD(frames)
   SERIALIZE_END(9)
 
+  // spr_line isn't serialized, since it can be rebuilt from OAM2
+  virtual void state_loaded() override {
+    this->build_spr_line();
+  }
+
   /*---------------  Hacks  --------------*/
 
   // fogleman NMI hack - gets some games to boot (eg: Bad Dudes)
@@ -245,9 +287,10 @@ private:
   /*---------------  Public  --------------*/
 
 public:
+  ~PPU();
   PPU() = delete;
   PPU(const NES_Params& params,
-    Memory& mem,
+    PPU_MMU& mem,
     DMA& dma,
     InterruptLines& interrupts
   );
@@ -271,8 +314,32 @@ public:
   void getFramebuffNESColorBgr(const u8** framebuffer) const;
   void getFramebuffNESColor   (const u8** framebuffer) const;
 
+  // NOTE: in compact mode, getFramebuff / getFramebuffNESColor return whatever
+  // target was set (if any), and the bgr / spr framebuffers are nullptr.
+
+  // Renders the RGBA framebuffer directly into caller-owned memory (which must
+  // be 256 * 240 * 4 bytes) instead of the PPU's own buffers, saving a copy.
+  // At vblank, the target is swapped to the front, and _callbacks.frame_ready
+  // is run. That's the time to hand the frame off, and set a fresh target.
+  // (otherwise, the PPU keeps rendering into the same memory)
+  // Passing nullptr switches back to the PPU's own buffers.
+  void setFramebuffTarget(u8* framebuffer);
+  // Same deal, but for the nes color framebuffer (256 * 240 bytes), which
+  // isn't double-buffered.
+  void setFramebuffNESColorTarget(u8* framebuffer);
+
   uint getNumFrames() const;
 
+  // Frameskip mode
+  // While set, the PPU only does work that affects emulation (sprite 0 hit,
+  // sprite overflow, mapper-visible memory fetches, vblank / NMI), and skips
+  // composing pixels altogether (i.e: the framebuffers are left untouched)
+  // (compact mode instances without any targets are always in frameskip mode)
+  void set_skip_render(bool skip) {
+    this->frameskip = skip;
+    this->update_skip_render();
+  }
+
   // NES color palette (static, for the time being)
   static const Color palette [64];
 
@@ -281,8 +348,8 @@ public:
 public:
   uint             _scancycle() const { return this->scan.cycle; }
   uint             _scanline()  const { return this->scan.line;  }
-  Memory&          _mem()             { return this->mem;        }
-  const Memory&    _mem()       const { return this->mem;        }
+  PPU_MMU&         _mem()             { return this->mem;        }
+  const PPU_MMU&   _mem()       const { return this->mem;        }
   const Registers& _reg()       const { return this->reg;        }
 
   struct {
@@ -291,6 +358,7 @@ public:
     CallbackManager<> scanline;
     CallbackManager<> frame_start;
     CallbackManager<> frame_end;
+    CallbackManager<> frame_ready; // a frame has been rendered (not skipped)
     CallbackManager<u16>     read_start;
     CallbackManager<u16, u8> read_end;
     CallbackManager<u16, u8> write_start;
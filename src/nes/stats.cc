@@ -0,0 +1,55 @@
+#include "stats.h"
+
+#include <cinttypes>
+#include <cstdio>
+
+const char* NES_Stats::csv_header() {
+  return "frames,cpu_instrs,cpu_cycles,ppu_dots,apu_samples,"
+         "ram_reads,ppu_reads,apu_io_reads,cart_reads,"
+         "ram_writes,ppu_writes,apu_io_writes,cart_writes,"
+         "bank_switches,irqs,nmis,"
+         "cpu_ticks,apu_ticks,ppu_ticks";
+}
+
+int NES_Stats::to_csv(char* buf, uint len) const {
+  return snprintf(buf, len,
+    "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ","
+    "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ","
+    "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ","
+    "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ","
+    "%" PRIu64 ",%" PRIu64 ",%" PRIu64,
+    this->frames, this->cpu_instrs, this->cpu_cycles, this->ppu_dots,
+    this->apu_samples,
+    this->bus_reads[BUS_RAM], this->bus_reads[BUS_PPU],
+    this->bus_reads[BUS_APU_IO], this->bus_reads[BUS_CART],
+    this->bus_writes[BUS_RAM], this->bus_writes[BUS_PPU],
+    this->bus_writes[BUS_APU_IO], this->bus_writes[BUS_CART],
+    this->bank_switches, this->irqs, this->nmis,
+    this->ticks.cpu, this->ticks.apu, this->ticks.ppu
+  );
+}
+
+int NES_Stats::to_json(char* buf, uint len) const {
+  #define BUS_JSON \
+    "{\"ram\":%" PRIu64 ",\"ppu\":%" PRIu64 \
+    ",\"apu_io\":%" PRIu64 ",\"cart\":%" PRIu64 "}"
+
+  return snprintf(buf, len,
+    "{\"frames\":%" PRIu64 ",\"cpu_instrs\":%" PRIu64
+    ",\"cpu_cycles\":%" PRIu64 ",\"ppu_dots\":%" PRIu64
+    ",\"apu_samples\":%" PRIu64
+    ",\"bus_reads\":" BUS_JSON ",\"bus_writes\":" BUS_JSON
+    ",\"bank_switches\":%" PRIu64 ",\"irqs\":%" PRIu64 ",\"nmis\":%" PRIu64
+    ",\"ticks\":{\"cpu\":%" PRIu64 ",\"apu\":%" PRIu64 ",\"ppu\":%" PRIu64 "}}",
+    this->frames, this->cpu_instrs, this->cpu_cycles, this->ppu_dots,
+    this->apu_samples,
+    this->bus_reads[BUS_RAM], this->bus_reads[BUS_PPU],
+    this->bus_reads[BUS_APU_IO], this->bus_reads[BUS_CART],
+    this->bus_writes[BUS_RAM], this->bus_writes[BUS_PPU],
+    this->bus_writes[BUS_APU_IO], this->bus_writes[BUS_CART],
+    this->bank_switches, this->irqs, this->nmis,
+    this->ticks.cpu, this->ticks.apu, this->ticks.ppu
+  );
+
+  #undef BUS_JSON
+}
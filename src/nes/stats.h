@@ -0,0 +1,76 @@
+#pragma once
+
+#include "common/util.h"
+
+#if defined(_MSC_VER)
+  #include <intrin.h>
+#elif defined(__i386__) || defined(__x86_64__)
+  #include <x86intrin.h>
+#else
+  #include <chrono>
+#endif
+
+// Emulation counters, for figuring out where the time goes in a particular
+// game (without having to attach a profiler).
+// Every counter is cumulative (since the NES was created), and isn't part of
+// the savestate. Diff two snapshots to get per-frame numbers.
+struct NES_Stats {
+  enum BusRegion {
+    BUS_RAM,    // 0x0000 - 0x1FFF
+    BUS_PPU,    // 0x2000 - 0x3FFF, 0x4014 (OAM DMA)
+    BUS_APU_IO, // 0x4000 - 0x401F (minus 0x4014)
+    BUS_CART,   // 0x4020 - 0xFFFF
+    BUS_REGIONS
+  };
+
+  u64 frames;
+  u64 cpu_instrs;  // incl. idle loop replays (which don't touch the bus)
+  u64 cpu_cycles;
+  u64 ppu_dots;
+  u64 apu_samples; // audio samples generated (none in compact mode)
+  // NOTE: reads from mapped PRG ROM (opcodes, operands, and data tables alike)
+  // skip the bus entirely (see CPU_MMU::fetch), so they aren't counted.
+  u64 bus_reads  [BUS_REGIONS];
+  u64 bus_writes [BUS_REGIONS];
+  u64 bank_switches; // PRG / CHR bank windows the mapper switched to a new bank
+  u64 irqs;
+  u64 nmis;
+
+  // Time spent in each subsystem, in timestamp() ticks.
+  // Only counted when NES_Params::profile is set, and estimated from every
+  // PROFILE_INTERVAL'th instruction (timing every single one would skew
+  // things way too much).
+  struct Ticks {
+    u64 cpu;
+    u64 apu;
+    u64 ppu; // incl. the mapper (which is clocked alongside the PPU)
+  } ticks;
+
+  static constexpr uint PROFILE_INTERVAL = 16;
+
+  // x86: CPU timestamp counter ticks (i.e: roughly CPU clock cycles)
+  // everything else: nanoseconds
+  // Either way, only ratios between ticks are meaningful.
+  static u64 timestamp() {
+#if defined(_MSC_VER) || defined(__i386__) || defined(__x86_64__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()
+    ).count();
+#endif
+  }
+
+  static BusRegion bus_region(u16 addr) {
+    if (addr < 0x2000) return BUS_RAM;
+    if (addr < 0x4000) return BUS_PPU;
+    if (addr < 0x4020) return addr == 0x4014 ? BUS_PPU : BUS_APU_IO;
+    return BUS_CART;
+  }
+
+  // Single line of JSON / CSV (without a trailing newline).
+  // Same semantics as snprintf (returns the length of the full string).
+  int to_json(char* buf, uint len) const;
+  int to_csv (char* buf, uint len) const;
+  static const char* csv_header();
+};
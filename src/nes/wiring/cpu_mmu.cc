@@ -33,6 +33,8 @@ CPU_MMU::CPU_MMU(
 #define ADDR2(lo, hi) if (in_range(addr, lo, hi))
 
 u8 CPU_MMU::read(u16 addr) {
+  this->_stats.reads[NES_Stats::bus_region(addr)]++;
+
   ADDR(0x0000, 0x1FFF) return this->ram.read(addr % 0x800);
   ADDR(0x2000, 0x3FFF) return this->ppu.read(addr % 8 + 0x2000);
   ADDR(0x4000, 0x4013) return this->apu.read(addr);
@@ -69,20 +71,27 @@ void CPU_MMU::write(u16 addr, u8 val) {
   // Some test roms provide test status info in addr 0x6000, and write c-style
   // null-terminated ascii strings starting at 0x6004
   // They signal this behavior by writing 0xDEB061 to 0x6001 - 0x6003
-  static uint debug_log = 0;
   if (in_range(addr, 0x6001, 0x6003))
-    debug_log |= val << ((2 - (addr - 0x6001)) * 8);
+    this->debug_log |= val << ((2 - (addr - 0x6001)) * 8);
+
+  if (this->debug_log == 0xDEB061) {
+    TestStatus& test = this->_test_status;
+    test.detected = true;
 
-  if (debug_log == 0xDEB061) {
-    if (addr == 0x6000)
-      fprintf(stderr, "Status: %X\n", val);
+    if (addr == 0x6000) {
+      test.status = val;
+      if (test.echo) fprintf(stderr, "Status: %X\n", val);
+    }
 
     if (in_range(addr, 0x6004, 0x6100)) {
-      fprintf(stderr, "%c", val);
+      test.text[addr - 0x6004] = val;
+      if (test.echo) fprintf(stderr, "%c", val);
     }
   }
   // END DEBUG
 
+  this->_stats.writes[NES_Stats::bus_region(addr)]++;
+
   ADDR(0x0000, 0x1FFF) return this->ram.write(addr % 0x800, val);
   ADDR(0x2000, 0x3FFF) return this->ppu.write(0x2000 + addr % 8, val);
   ADDR(0x4000, 0x4013) return this->apu.write(addr, val);
@@ -3,6 +3,7 @@
 #include "common/util.h"
 #include "nes/cartridge/mapper.h"
 #include "nes/interfaces/memory.h"
+#include "nes/stats.h"
 
 // CPU Memory Map (MMU)
 // NESdoc.pdf
@@ -18,7 +19,26 @@ private:
 
   // Changing References
   Mapper* cart;
+
+  // Test ROM status-output signature (see CPU_MMU::write)
+  // (per-instance, since multiple NESs may be running on different threads)
+  uint debug_log = 0;
 public:
+  // Test ROM status, as reported through the 0xDEB061 protocol
+  // (see CPU_MMU::write)
+  struct TestStatus {
+    enum : u8 {
+      RUNNING     = 0x80,
+      NEEDS_RESET = 0x81,
+      // anything below 0x80 is the final result (0 = passed)
+    };
+
+    bool detected = false; // has the ROM written the signature yet?
+    u8   status = RUNNING;
+    char text [0x100] = {}; // null-terminated text output
+    bool echo = true;       // print status / text to stderr
+  };
+
   CPU_MMU() = delete;
   CPU_MMU(
     Memory& ram,
@@ -33,6 +53,36 @@ public:
   void write(u16 addr, u8 val) override;
   // <Memory/>
 
+  // Instruction (and operand) fetch
+  // Same as read, except that fetches from PRG ROM skip the bus entirely.
+  // Most code runs from ROM, so this saves a whole lot of virtual calls.
+  u8 fetch(u16 addr) {
+    if (addr >= 0x8000 && this->cart)
+      if (const u8* rom = this->cart->prg_rom_ptr(addr))
+        return *rom;
+    return this->read(addr);
+  }
+
+  // Is addr backed by mapped PRG ROM? (i.e: reads are side-effect free)
+  bool is_prg_rom(u16 addr) const {
+    return addr >= 0x8000 && this->cart && this->cart->prg_rom_ptr(addr);
+  }
+
+  // see Mapper::prg_rom_offset
+  int prg_rom_offset(u16 addr) const {
+    return addr >= 0x8000 && this->cart ? this->cart->prg_rom_offset(addr) : -1;
+  }
+
   void loadCartridge(Mapper* cart);
   void removeCartridge();
+
+  /*---------------  Debugging / Instrumentation  --------------*/
+
+  // see NES_Stats
+  struct {
+    u64 reads  [NES_Stats::BUS_REGIONS] = {};
+    u64 writes [NES_Stats::BUS_REGIONS] = {};
+  } _stats;
+
+  TestStatus _test_status;
 };
@@ -73,7 +73,12 @@ u8 PPU_MMU::peek(u16 addr) const {
 void PPU_MMU::write(u16 addr, u8 val) {
   this->set_mirroring();
 
-  ADDR(0x0000, 0x1FFF) return this->cart ? this->cart->write(addr, val) : void();
+  ADDR(0x0000, 0x1FFF) {
+    if (!this->cart) return;
+    this->cart->write(addr, val);
+    this->cart->chr_written(addr); // might have been CHR RAM
+    return;
+  }
   ADDR(0x2000, 0x2FFF) return this->vram->write(this->nt_mirror(addr), val);
   ADDR(0x3000, 0x3EFF) return this->write(addr - 0x1000, val);
   ADDR(0x3F00, 0x3FFF) return this->pram.write(pram_mirror(addr), val);
@@ -83,6 +88,11 @@ void PPU_MMU::write(u16 addr, u8 val) {
   assert(false);
 }
 
+const u8* PPU_MMU::chr_tile_row(u16 addr, bool flip_h) const {
+  static const u8 no_cart [8] = {0};
+  return this->cart ? this->cart->chr_tile_row(addr, flip_h) : no_cart;
+}
+
 void PPU_MMU::set_mirroring() {
   static constexpr uint nt_mirroring [5][4] = {
     /* Vertical       */ { 0, 1, 0, 1 },
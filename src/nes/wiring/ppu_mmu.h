@@ -40,6 +40,9 @@ public:
   void write(u16 addr, u8 val) override;
   // <Memory/>
 
+  // Pre-decoded pattern table rows (see Mapper::chr_tile_row)
+  const u8* chr_tile_row(u16 addr, bool flip_h) const;
+
   void loadCartridge(Mapper* cart);
   void removeCartridge();
 };
@@ -13,9 +13,10 @@ void Config::load(int argc, char* argv[]) {
   bool show_help = false;
   auto cli
     = clara::Help(show_help)
-    | clara::Opt(this->cli.log_cpu)
+    | clara::Opt(this->cli.log_cpu_path, "path")
         ["--log-cpu"]
-        ("Output CPU execution over STDOUT")
+        ("Record a binary CPU trace \n"
+         "(format it with anese_cpu_trace)")
     | clara::Opt(this->cli.no_sav)
         ["--no-sav"]
         ("Don't load/create sav/savestate files")
@@ -38,6 +39,25 @@ void Config::load(int argc, char* argv[]) {
     | clara::Opt(this->cli.widenes)
         ["--widenes"]
         ("enable wideNES")
+    | clara::Opt(this->cli.trace_path, "path")
+        ["--trace"]
+        ("Record a timeline of every frame, and write it to a \n"
+         "Chrome trace JSON file on exit (see chrome://tracing)")
+    | clara::Opt(this->cli.profile_cpu_path, "path")
+        ["--profile-cpu"]
+        ("Count CPU cycles per instruction / subroutine, and \n"
+         "write a hotspot report to <path> (and a flamegraph \n"
+         "folded-stack file to <path>.folded) on exit")
+    | clara::Opt(this->cli.late_input)
+        ["--late-input"]
+        ("Read the controller right as the game asks for it, \n"
+         "instead of once per frame (less input lag). Runs \n"
+         "the NES on the GUI thread.")
+    | clara::Opt(this->cli.frame_delay, "ms")
+        ["--frame-delay"]
+        ("Wait this long after each vsync before running the \n"
+         "next frame, so it sees fresher input (eg: 8). Runs \n"
+         "the NES on the GUI thread.")
     | clara::Arg(this->cli.rom, "rom")
         ("an iNES rom");
 
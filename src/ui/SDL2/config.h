@@ -25,7 +25,7 @@ public:
 
   /*----------  CLI Args (not saved)  ----------*/
   struct {
-    bool log_cpu = false;
+    std::string log_cpu_path;
     bool no_sav  = false;
     bool ppu_timing_hack = false;
 
@@ -37,6 +37,12 @@ public:
 
     std::string config_file;
 
+    std::string trace_path;
+    std::string profile_cpu_path;
+
+    bool late_input = false;
+    uint frame_delay = 0; // ms
+
     std::string rom;
   } cli;
 };
@@ -2,6 +2,7 @@
 
 #include <cstdio>
 
+#include "common/trace.h"
 #include "common/util.h"
 
 #include "gui_modules/emu.h"
@@ -12,14 +13,21 @@ SDL_GUI::SDL_GUI(int argc, char* argv[]) {
   // Init config
   this->config.load(argc, argv);
 
+  if (!this->config.cli.trace_path.empty())
+    Trace::enable();
+
   // Init NES params
-  this->nes_params.log_cpu         = this->config.cli.log_cpu;
+  this->nes_params.log_cpu         = !this->config.cli.log_cpu_path.empty();
   this->nes_params.ppu_timing_hack = this->config.cli.ppu_timing_hack;
   this->nes_params.apu_sample_rate = 96000;
   this->nes_params.speed           = 100;
+  this->nes_params.compact         = false;
+  this->nes_params.profile         = false;
+  this->nes_params.profile_cpu     = !this->config.cli.profile_cpu_path.empty();
 
   // Init NES
   this->nes = new NES(this->nes_params);
+  this->nes_mutex = SDL_CreateMutex();
 
   // Init SDL_Common
   fprintf(stderr, "[SDL2] Initializing SDL2 GUI\n");
@@ -41,6 +49,10 @@ SDL_GUI::SDL_GUI(int argc, char* argv[]) {
     *this->nes
   );
 
+  // The PPU renders straight into the frame handoff buffers
+  this->nes->_ppu().setFramebuffTarget(this->shared->frames.write_buffer());
+  this->nes->_ppu()._callbacks.frame_ready.add_cb(SDL_GUI::cb_frame_ready, this);
+
   this->modules["emu"] = (GUIModule*)new EmuModule(*this->shared);
 
   if (this->config.cli.ppu_debug)
@@ -64,86 +76,232 @@ SDL_GUI::~SDL_GUI() {
 
   delete this->shared;
 
+  if (this->nes_params.profile_cpu)
+    this->write_cpu_profile();
+
   delete this->nes;
+  SDL_DestroyMutex(this->nes_mutex);
+
+  if (Trace::enabled)
+    Trace::write(this->config.cli.trace_path.c_str());
 
   printf("\nANESE closed successfully\n");
 }
 
+void SDL_GUI::write_cpu_profile() const {
+  const std::string& path = this->config.cli.profile_cpu_path;
+  CPU_Profiler& profiler = this->nes->_cpu()._profiler();
+
+  FILE* f = fopen(path.c_str(), "w");
+  if (!f) {
+    fprintf(stderr, "[SDL2] Could not open '%s' for writing!\n", path.c_str());
+    return;
+  }
+  profiler.write_report(f);
+  fclose(f);
+
+  f = fopen((path + ".folded").c_str(), "w");
+  if (!f) {
+    fprintf(stderr, "[SDL2] Could not open '%s.folded' for writing!\n",
+      path.c_str());
+    return;
+  }
+  profiler.write_folded(f);
+  fclose(f);
+
+  fprintf(stderr, "[SDL2] Wrote CPU profile to '%s'\n", path.c_str());
+}
+
 void SDL_GUI::input_global(const SDL_Event& event) {
   if (
     (event.type == SDL_QUIT) ||
     (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_CLOSE)
-  ) this->running = false;
+  ) SDL_AtomicSet(&this->running, false);
+}
+
+void SDL_GUI::update_fups(u64 start_time, u64 end_time) {
+  this->past_fups_i++;
+
+  // Update fups for this frame
+  this->past_fups[this->past_fups_i % 20] = double(SDL_GetPerformanceFrequency())
+                                          / double(end_time - start_time);
+
+  // Get the average fups over the past 20 frames
+  double avg_fps = 0;
+  for(unsigned i = 0; i < 20; i++)
+    avg_fps += this->past_fups[i];
+  avg_fps /= 20;
+
+  SDL_AtomicSet(&this->status.avg_fps, int(avg_fps));
+}
+
+void SDL_GUI::cb_frame_ready(void* self) {
+  SDL_GUI& gui = *(SDL_GUI*)self;
+  gui.shared->frames.publish();
+  gui.nes->_ppu().setFramebuffTarget(gui.shared->frames.write_buffer());
+}
+
+// Runs the NES for however many frames the current speed calls for.
+// (finished frames are handed off to be presented through cb_frame_ready)
+// Returns the number of frames that were run.
+uint SDL_GUI::step_emulation() {
+  TRACE_SCOPE("SDL_GUI::step_emulation");
+
+  // Calculate the number of frames to render
+  // Speedup values that are not multiples of 100 cause every-other frame to
+  // render 1 more/less frame than usual
+  uint numframes = 0;
+  this->speed_counter += this->nes_params.speed;
+  SDL_AtomicSet(&this->status.speed, this->nes_params.speed);
+  while (this->speed_counter > 0) {
+    this->speed_counter -= 100;
+    numframes++;
+  }
+
+  // Only the last frame gets presented, so there's no point in rendering
+  // the others (unless widenes needs to see them)
+  const bool can_skip = this->modules.count("widenes") == 0;
+
+  // Run ANESE for some number of frames
+  for (uint i = 0; i < numframes; i++) {
+    if (!SDL_AtomicGet(&this->status.in_menu)) {
+      if (can_skip && i != numframes - 1)
+        this->nes->skip_frame();
+      else
+        this->nes->step_frame();
+    }
+
+    // Update modules
+    for (auto& p : this->modules)
+      p.second->update();
+  }
+
+  return numframes;
+}
+
+int SDL_GUI::emu_thread_main(void* self) {
+  ((SDL_GUI*)self)->emu_thread_loop();
+  return 0;
+}
+
+void SDL_GUI::emu_thread_loop() {
+  fprintf(stderr, "[SDL2] Running emulation thread\n");
+  Trace::thread_name("emulation");
+
+  while (SDL_AtomicGet(&this->running)) {
+    // Let the GUI thread go first if it has some input to dispatch
+    while (SDL_AtomicGet(&this->input_pending))
+      SDL_Delay(0);
+
+    u64 start_time = SDL_GetPerformanceCounter();
+
+    // While in the menu, the GUI thread runs the updates itself (see run())
+    SDL_LockMutex(this->nes_mutex);
+    const bool in_menu = SDL_AtomicGet(&this->status.in_menu);
+    const uint numframes = in_menu ? 0 : this->step_emulation();
+    SDL_UnlockMutex(this->nes_mutex);
+
+    // Emulation is paced by the audio queue, but there's no audio while in the
+    // menu, so take a little nap instead
+    if (in_menu) {
+      SDL_Delay(10);
+      continue;
+    }
+
+    if (numframes)
+      this->update_fups(start_time, SDL_GetPerformanceCounter());
+  }
+
+  fprintf(stderr, "[SDL2] Stopping emulation thread\n");
 }
 
 int SDL_GUI::run() {
   fprintf(stderr, "[SDL2] Running SDL2 GUI\n");
+  Trace::thread_name("gui");
 
   // Load ROM if one has been passed as param
   if (this->config.cli.rom != "") {
-    this->status.in_menu = false;
+    SDL_AtomicSet(&this->status.in_menu, false);
     int error = this->shared->load_rom(this->config.cli.rom.c_str());
     if (error)
       return error;
   }
 
-  double past_fups [20] = {60.0}; // more samples == less value jitter
-  uint past_fups_i = 0;
+  // The debug modules hook directly into the NES (and make SDL calls from
+  // within those hooks), so when they are running, everything stays on a
+  // single thread.
+  // Same goes for --frame-delay, which needs emulation to be paced by vsync,
+  // and --late-input, which reads SDL's input state from within the NES (and
+  // SDL only pumps events on the GUI thread).
+  if (this->modules.size() == 1
+    && !this->config.cli.frame_delay
+    && !this->config.cli.late_input) {
+    this->emu_thread = SDL_CreateThread(SDL_GUI::emu_thread_main, "anese", this);
+    if (!this->emu_thread)
+      fprintf(stderr, "[SDL2] Could not create emulation thread: %s\n",
+        SDL_GetError());
+  }
 
-  while (this->running) {
-    typedef uint time_ms;
-    time_ms frame_start_time = SDL_GetTicks();
-    past_fups_i++;
+  std::vector<SDL_Event> events;
 
-    // Check for new events
-    SDL_Event event;
-    while (SDL_PollEvent(&event) != 0) {
-      this->input_global(event);
+  while (SDL_AtomicGet(&this->running)) {
+    TRACE_SCOPE("SDL_GUI::frame");
+    u64 frame_start_time = SDL_GetPerformanceCounter();
 
-      for (auto& p : this->modules) {
-        if (event.window.windowID == p.second->get_window_id())
-          p.second->input(event);
-      }
+    // The last present just returned (i.e: vsync just happened), so hold off
+    // on polling input + emulating the next frame until closer to the next one
+    if (!this->emu_thread && this->config.cli.frame_delay) {
+      TRACE_SCOPE("SDL_GUI::frame_delay");
+      SDL_Delay(this->config.cli.frame_delay);
     }
 
-    // Calculate the number of frames to render
-    // Speedup values that are not multiples of 100 cause every-other frame to
-    // render 1 more/less frame than usual
-    uint numframes = 0;
-    this->speed_counter += this->nes_params.speed;
-    while (this->speed_counter > 0) {
-      this->speed_counter -= 100;
-      numframes++;
+    // Check for new events
+    events.clear();
+    {
+      TRACE_SCOPE("SDL_GUI::poll_input");
+      SDL_Event event;
+      while (SDL_PollEvent(&event) != 0)
+        events.push_back(event);
     }
 
-    // Run ANESE for some number of frames
-    for (uint i = 0; i < numframes; i++) {
-      if (!this->status.in_menu)
-        this->nes->step_frame();
+    // Dispatch them (the modules are free to poke at the NES while doing so)
+    const bool in_menu = SDL_AtomicGet(&this->status.in_menu);
+    if (!events.empty() || !this->emu_thread || in_menu) {
+      TRACE_SCOPE("SDL_GUI::dispatch_input");
+      SDL_AtomicSet(&this->input_pending, true);
+      SDL_LockMutex(this->nes_mutex);
+      SDL_AtomicSet(&this->input_pending, false);
+
+      for (const SDL_Event& event : events) {
+        this->input_global(event);
+
+        for (auto& p : this->modules) {
+          if (event.window.windowID == p.second->get_window_id())
+            p.second->input(event);
+        }
+      }
+
+      // Single-threaded: run the NES right here
+      // The menu shuffles around the file listing that output() draws (and
+      // loads ROMs), so while it's open, it gets updated here too.
+      if (!this->emu_thread || SDL_AtomicGet(&this->status.in_menu)) {
+        this->step_emulation();
+      }
 
-      // Update modules
-      for (auto& p : this->modules)
-        p.second->update();
+      SDL_UnlockMutex(this->nes_mutex);
     }
 
     // Render stuff!
     for (auto& p : this->modules)
       p.second->output();
 
-    // time how long all-that took
-    time_ms frame_end_time = SDL_GetTicks();
-
-    // ---- Count Framerate ---- //
-    // Update fups for this frame
-    past_fups[past_fups_i % 20] = 1000.0 / (frame_end_time - frame_start_time);
-
-    // Get the average fups over the past 20 frames
-    double avg_fps = 0;
-    for(unsigned i = 0; i < 20; i++)
-      avg_fps += past_fups[i];
-    avg_fps /= 20;
+    if (!this->emu_thread)
+      this->update_fups(frame_start_time, SDL_GetPerformanceCounter());
+  }
 
-    this->status.avg_fps = avg_fps;
+  if (this->emu_thread) {
+    SDL_WaitThread(this->emu_thread, nullptr);
+    this->emu_thread = nullptr;
   }
 
   return 0;
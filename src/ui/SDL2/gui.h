@@ -14,7 +14,7 @@
 
 class SDL_GUI final {
 private:
-  bool running = true;
+  SDL_atomic_t running { true };
 
   /*----------  Shared State  ----------*/
 
@@ -31,9 +31,33 @@ private:
 
   int speed_counter = 0;
 
+  uint step_emulation();
+  static void cb_frame_ready(void* self);
+
+  /*----------  Emulation Thread  ----------*/
+  // When possible, the NES runs on it's own thread, and hands finished frames
+  // off to the GUI thread through shared->frames (which the PPU renders into
+  // directly).
+  // Anything touching the NES must hold nes_mutex while doing so.
+  // While the menu is open, the GUI thread runs the module updates instead,
+  // since the menu loads ROMs and rebuilds the file listing it draws.
+
+  SDL_Thread*  emu_thread = nullptr;
+  SDL_mutex*   nes_mutex  = nullptr;
+  SDL_atomic_t input_pending { false };
+
+  static int emu_thread_main(void* self);
+  void emu_thread_loop();
+
+  /*----------  Framerate  ----------*/
+
+  double past_fups [20] = {60.0}; // more samples == less value jitter
+  uint past_fups_i = 0;
+  void update_fups(u64 start_time, u64 end_time);
 
 private:
   void input_global(const SDL_Event&);
+  void write_cpu_profile() const; // see --profile-cpu
 
 public:
   SDL_GUI(int argc, char* argv[]);
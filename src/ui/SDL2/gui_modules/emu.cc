@@ -2,6 +2,8 @@
 
 #include <cstdio>
 
+#include "common/trace.h"
+
 #include "../fs/load.h"
 #include "../fs/util.h"
 
@@ -97,6 +99,38 @@ EmuModule::EmuModule(SharedState& gui)
     this->gui.nes.attach_joy(0, this->fm2_replay.get_joy(0));
     this->gui.nes.attach_joy(1, this->fm2_replay.get_joy(1));
   }
+
+  // ------------------------------ Late Input ------------------------------ //
+
+  if (this->gui.config.cli.late_input)
+    this->joy_1._callbacks.poll.add_cb(EmuModule::cb_poll_joy_1, this);
+
+  // ------------------------------ CPU Trace ------------------------------- //
+
+  if (this->gui.nes_params.log_cpu) {
+    this->cpu_trace_writer.start(
+      this->gui.config.cli.log_cpu_path.c_str(),
+      this->gui.nes._cpu()._trace()
+    );
+  }
+}
+
+void EmuModule::toggle_cpu_trace() {
+  bool log = this->gui.nes_params.log_cpu = !this->gui.nes_params.log_cpu;
+  this->gui.nes.updated_params();
+  fprintf(stderr, "CPU logging: %s\n", log ? "ON" : "OFF");
+
+  // Without a --log-cpu file, the trace just sits in memory (the CPU dumps
+  // the last few instructions if it crashes).
+  // Otherwise, the writer keeps running while logging is off (there's simply
+  // nothing for it to write), so the whole session ends up in one file.
+  if (log && !this->cpu_trace_writer.is_running()
+      && !this->gui.config.cli.log_cpu_path.empty()) {
+    this->cpu_trace_writer.start(
+      this->gui.config.cli.log_cpu_path.c_str(),
+      this->gui.nes._cpu()._trace()
+    );
+  }
 }
 
 EmuModule::~EmuModule() {
@@ -104,6 +138,8 @@ EmuModule::~EmuModule() {
 
   delete this->menu_submodule;
 
+  this->cpu_trace_writer.stop();
+
   /*------------------------------  SDL Cleanup  -----------------------------*/
 
   SDL_DestroyTexture(this->sdl.screen_texture);
@@ -111,9 +147,49 @@ EmuModule::~EmuModule() {
   SDL_DestroyWindow(this->sdl.window);
 }
 
+// Player 1's keyboard / controller bindings
+namespace {
+struct Binding {
+  SDL_Keycode key;
+  SDL_GameControllerButton button;
+  JOY_Standard_Button::Type btn;
+};
+
+const Binding joy_1_bindings [] = {
+  { SDLK_z,      SDL_CONTROLLER_BUTTON_A,          JOY_Standard_Button::A      },
+  { SDLK_x,      SDL_CONTROLLER_BUTTON_X,          JOY_Standard_Button::B      },
+  { SDLK_RETURN, SDL_CONTROLLER_BUTTON_START,      JOY_Standard_Button::Start  },
+  { SDLK_RSHIFT, SDL_CONTROLLER_BUTTON_BACK,       JOY_Standard_Button::Select },
+  { SDLK_UP,     SDL_CONTROLLER_BUTTON_DPAD_UP,    JOY_Standard_Button::Up     },
+  { SDLK_DOWN,   SDL_CONTROLLER_BUTTON_DPAD_DOWN,  JOY_Standard_Button::Down   },
+  { SDLK_LEFT,   SDL_CONTROLLER_BUTTON_DPAD_LEFT,  JOY_Standard_Button::Left   },
+  { SDLK_RIGHT,  SDL_CONTROLLER_BUTTON_DPAD_RIGHT, JOY_Standard_Button::Right  },
+};
+} // namespace
+
+// Late input polling (--late-input)
+// Samples player 1's buttons right as the game latches them, instead of using
+// whatever the last batch of events dispatched by the GUI thread said.
+// NOTE: --late-input keeps the NES on the GUI thread (see SDL_GUI::run), since
+// SDL's keyboard / controller state can only be safely read (and pumped) there.
+void EmuModule::cb_poll_joy_1(void* self, JOY_Standard* joy) {
+  EmuModule& emu = *(EmuModule*)self;
+
+  // grab the freshest events from the OS
+  SDL_PumpEvents();
+
+  const Uint8* keys = SDL_GetKeyboardState(nullptr);
+  SDL_GameController* controller = emu.gui.sdl.controller;
+  for (const Binding& binding : joy_1_bindings) {
+    joy->set_button(binding.btn,
+      keys[SDL_GetScancodeFromKey(binding.key)] ||
+      (controller && SDL_GameControllerGetButton(controller, binding.button)));
+  }
+}
+
 void EmuModule::input(const SDL_Event& event) {
   this->menu_submodule->input(event);
-  if (this->gui.status.in_menu) return;
+  if (SDL_AtomicGet(&this->gui.status.in_menu)) return;
 
   // Update from Controllers
   if (event.type == SDL_CONTROLLERBUTTONDOWN ||
@@ -122,16 +198,9 @@ void EmuModule::input(const SDL_Event& event) {
     using namespace JOY_Standard_Button;
 
     // Player 1
-    switch (event.cbutton.button) {
-    case SDL_CONTROLLER_BUTTON_A:          this->joy_1.set_button(A,      new_state); break;
-    case SDL_CONTROLLER_BUTTON_X:          this->joy_1.set_button(B,      new_state); break;
-    case SDL_CONTROLLER_BUTTON_START:      this->joy_1.set_button(Start,  new_state); break;
-    case SDL_CONTROLLER_BUTTON_BACK:       this->joy_1.set_button(Select, new_state); break;
-    case SDL_CONTROLLER_BUTTON_DPAD_UP:    this->joy_1.set_button(Up,     new_state); break;
-    case SDL_CONTROLLER_BUTTON_DPAD_DOWN:  this->joy_1.set_button(Down,   new_state); break;
-    case SDL_CONTROLLER_BUTTON_DPAD_LEFT:  this->joy_1.set_button(Left,   new_state); break;
-    case SDL_CONTROLLER_BUTTON_DPAD_RIGHT: this->joy_1.set_button(Right,  new_state); break;
-    }
+    for (const Binding& binding : joy_1_bindings)
+      if (event.cbutton.button == binding.button)
+        this->joy_1.set_button(binding.btn, new_state);
 
     // Player 2
     // switch (event.cbutton.button) {
@@ -154,16 +223,9 @@ void EmuModule::input(const SDL_Event& event) {
     using namespace JOY_Standard_Button;
 
     // Player 1
-    switch (event.key.keysym.sym) {
-    case SDLK_z:      this->joy_1.set_button(A,      new_state); break;
-    case SDLK_x:      this->joy_1.set_button(B,      new_state); break;
-    case SDLK_RETURN: this->joy_1.set_button(Start,  new_state); break;
-    case SDLK_RSHIFT: this->joy_1.set_button(Select, new_state); break;
-    case SDLK_UP:     this->joy_1.set_button(Up,     new_state); break;
-    case SDLK_DOWN:   this->joy_1.set_button(Down,   new_state); break;
-    case SDLK_LEFT:   this->joy_1.set_button(Left,   new_state); break;
-    case SDLK_RIGHT:  this->joy_1.set_button(Right,  new_state); break;
-    }
+    for (const Binding& binding : joy_1_bindings)
+      if (event.key.keysym.sym == binding.key)
+        this->joy_1.set_button(binding.btn, new_state);
 
     // Player 2
     // switch (event.key.keysym.sym) {
@@ -258,12 +320,7 @@ void EmuModule::input(const SDL_Event& event) {
           this->gui.nes.updated_params();
         }
         break;
-      case SDLK_c: {
-        // Toggle CPU trace
-        bool log = this->gui.nes_params.log_cpu = !this->gui.nes_params.log_cpu;
-        this->gui.nes.updated_params();
-        fprintf(stderr, "NESTEST CPU logging: %s\n", log ? "ON" : "OFF");
-      } break;
+      case SDLK_c: this->toggle_cpu_trace(); break; // Toggle CPU trace
       default: break;
       }
     }
@@ -271,8 +328,13 @@ void EmuModule::input(const SDL_Event& event) {
 }
 
 void EmuModule::update() {
-  this->menu_submodule->update();
-  if (this->gui.status.in_menu) return;
+  TRACE_SCOPE("EmuModule::update");
+  // The menu only updates while it's open, at which point the GUI thread is
+  // the one running updates (see SDL_GUI::run)
+  if (SDL_AtomicGet(&this->gui.status.in_menu)) {
+    this->menu_submodule->update();
+    return;
+  }
 
   // log frame to fm2
   if (this->fm2_record.is_enabled())
@@ -281,20 +343,27 @@ void EmuModule::update() {
   // set input from fm2
   if (this->fm2_replay.is_enabled())
     this->fm2_replay.step_frame();
-}
 
-void EmuModule::output() {
   // output audio!
+  // (this happens alongside emulation, since it's what keeps it running at the
+  // right speed)
   float* samples = nullptr;
   uint   count = 0;
   this->gui.nes.getAudiobuff(&samples, &count);
   // SDL_QueueAudio(this->gui.sdl.nes_audiodev, samples, count * sizeof(float));
   if (count) this->sdl.sound_queue.write(samples, count);
+}
 
-  // output video!
-  const u8* framebuffer;
-  this->gui.nes.getFramebuff(&framebuffer);
-  SDL_UpdateTexture(this->sdl.screen_texture, nullptr, framebuffer, 256 * 4);
+void EmuModule::output() {
+  TRACE_SCOPE("EmuModule::output");
+
+  // output video! (but only if there's a new frame)
+  if (this->gui.frames.update()) {
+    SDL_UpdateTexture(
+      this->sdl.screen_texture, nullptr,
+      this->gui.frames.read_buffer(), 256 * 4
+    );
+  }
 
   // actual NES screen
   SDL_SetRenderDrawColor(this->sdl.renderer, 0, 0, 0, 0xff);
@@ -303,11 +372,15 @@ void EmuModule::output() {
 
   this->menu_submodule->output();
 
-  SDL_RenderPresent(this->sdl.renderer);
+  {
+    TRACE_SCOPE("EmuModule::present");
+    SDL_RenderPresent(this->sdl.renderer);
+  }
 
   // Present fups though the title of the main window
   char window_title [64];
   sprintf(window_title, "anese - %u fups - %u%% speed",
-    uint(this->gui.status.avg_fps), this->gui.nes_params.speed);
+    uint(SDL_AtomicGet(&this->gui.status.avg_fps)),
+    uint(SDL_AtomicGet(&this->gui.status.speed)));
   SDL_SetWindowTitle(this->sdl.window, window_title);
 }
@@ -18,6 +18,7 @@
 #include "../movies/fm2/replay.h"
 
 #include "../util/Sound_Queue.h"
+#include "../util/cpu_trace_writer.h"
 
 class EmuModule : public GUIModule {
 private:
@@ -37,12 +38,19 @@ private:
   JOY_Standard joy_2 { "P2" };
   JOY_Zapper   zap_2 { "Z2" };
 
+  // Late input polling (see --late-input)
+  static void cb_poll_joy_1(void* self, JOY_Standard* joy);
+
   // Movie Controllers
   FM2_Replay fm2_replay;
   FM2_Record fm2_record;
 
   MenuSubModule* menu_submodule;
 
+  // CPU trace (while NES_Params::log_cpu is set)
+  CPU_TraceWriter cpu_trace_writer;
+  void toggle_cpu_trace();
+
 public:
   virtual ~EmuModule();
   EmuModule(SharedState& gui);
@@ -168,23 +168,16 @@ void PPUDebugModule::sample_ppu() {
     uint palette, // from 0 - 4
     DebugPixelbuffWindow* window
   ) {
+    // lookup the 4 colors once, instead of once per-pixel
+    Color colors [4];
+    for (uint i = 0; i < 4; i++)
+      colors[i] = ppu.palette[ppu._mem().peek(0x3F00 + palette * 4 + i) % 64];
+
     for (uint y = 0; y < 8; y++) {
-      u8 lo_bp = ppu._mem().peek(tile_addr + y + 0);
-      u8 hi_bp = ppu._mem().peek(tile_addr + y + 8);
+      const u8* row = ppu._mem().chr_tile_row(tile_addr + y, false);
 
       for (uint x = 0; x < 8; x++) {
-        uint pixel_type = nth_bit(lo_bp, x) + (nth_bit(hi_bp, x) << 1);
-
-        Color color = ppu.palette[
-          ppu._mem().peek(0x3F00 + palette * 4 + pixel_type) % 64
-        ];
-
-        window->set_pixel(
-          tl_x + (7 - x),
-          tl_y + y,
-
-          color
-        );
+        window->set_pixel(tl_x + x, tl_y + y, colors[row[x]]);
       }
     }
   };
@@ -32,23 +32,26 @@ MenuSubModule::~MenuSubModule() {
   this->gui.unload_rom();
 }
 
+void MenuSubModule::toggle() {
+  SDL_AtomicSet(&this->gui.status.in_menu,
+    !SDL_AtomicGet(&this->gui.status.in_menu));
+}
+
 void MenuSubModule::input(const SDL_Event& event) {
   // First, check if actions should even be recorded...
   if (event.type == SDL_KEYDOWN) {
     switch (event.key.keysym.sym) {
-    case SDLK_ESCAPE:
-      this->gui.status.in_menu = !this->gui.status.in_menu; break;
+    case SDLK_ESCAPE: this->toggle(); break;
     }
   }
   if (event.type == SDL_CONTROLLERBUTTONDOWN ||
       event.type == SDL_CONTROLLERBUTTONUP) {
     switch (event.cbutton.button) {
-    case SDL_CONTROLLER_BUTTON_LEFTSTICK:
-      this->gui.status.in_menu = !this->gui.status.in_menu; break;
+    case SDL_CONTROLLER_BUTTON_LEFTSTICK: this->toggle(); break;
     }
   }
 
-  if (!this->gui.status.in_menu) return;
+  if (!SDL_AtomicGet(&this->gui.status.in_menu)) return;
 
   if (event.type == SDL_KEYDOWN) {
     switch (event.key.keysym.sym) {
@@ -98,7 +101,7 @@ void MenuSubModule::update() {
       fprintf(stderr, "[Menu] Selected '%s'\n", file.name);
       this->gui.unload_rom();
       this->gui.load_rom(file.path);
-      this->gui.status.in_menu = false;
+      SDL_AtomicSet(&this->gui.status.in_menu, false);
     }
   }
 
@@ -182,7 +185,7 @@ void MenuSubModule::update() {
 }
 
 void MenuSubModule::output() {
-  if (!this->gui.status.in_menu) return;
+  if (!SDL_AtomicGet(&this->gui.status.in_menu)) return;
   // menu uses the EmuModule's rendering context
 
   // Paint transparent bg
@@ -15,6 +15,8 @@ private:
   SDL_Rect bg;
   SDL2_inprint* inprint;
 
+  void toggle();
+
 public:
   struct {
     std::vector<cf_file_t> files;
@@ -38,6 +40,8 @@ public:
   MenuSubModule(SharedState& gui, SDL_Window* window, SDL_Renderer* renderer);
 
   void input(const SDL_Event&) override;
+  // Navigates / loads ROMs, so this must only ever run on the GUI thread
+  // (output() walks the file listing without taking any locks)
   void update() override;
   void output() override;
 };
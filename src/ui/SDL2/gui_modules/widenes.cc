@@ -8,6 +8,8 @@
 #include <stb_image.h>
 #include <cute_files.h>
 
+#include "common/trace.h"
+
 WideNESModule::WideNESModule(SharedState& gui)
 : GUIModule(gui)
 {
@@ -87,6 +89,7 @@ void WideNESModule::clear_scenes() {
 #include "../fs/util.h"
 
 void WideNESModule::save_scenes() {
+  TRACE_SCOPE("WideNESModule::save_scenes");
   ANESE_fs::util::create_directory(this->scenes_path.c_str());
 
   FILE* hashes = fopen((this->scenes_path + "/hashes.txt").c_str(), "wb");
@@ -136,6 +139,7 @@ void WideNESModule::save_scenes() {
 #include <climits>
 
 void WideNESModule::load_scenes() {
+  TRACE_SCOPE("WideNESModule::load_scenes");
   int max_scene_id = INT_MIN;
 
   this->scenes_path = this->gui.current_rom_file + "_scenes";
@@ -230,7 +234,7 @@ void WideNESModule::load_scenes() {
 
 void WideNESModule::input(const SDL_Event& event) {
   this->menu_submodule->input(event);
-  if (this->gui.status.in_menu) return;
+  if (SDL_AtomicGet(&this->gui.status.in_menu)) return;
 
   // Update from Mouse
   if (event.type == SDL_MOUSEBUTTONDOWN) {
@@ -283,6 +287,7 @@ void WideNESModule::input(const SDL_Event& event) {
 }
 
 void WideNESModule::update() {
+  TRACE_SCOPE("WideNESModule::update");
   this->menu_submodule->update();
   // aside from that, nothing.
   // updates happen in callbacks
@@ -535,6 +540,7 @@ void WideNESModule::fix_scrolling() {
 }
 
 void WideNESModule::ppu_frame_end_handler() {
+  TRACE_SCOPE("WideNESModule::ppu_frame_end");
   const PPU& ppu = this->gui.nes._ppu();
 
   const u8* framebuffer;
@@ -883,6 +889,8 @@ void WideNESModule::ppu_frame_end_handler() {
 /*---------------------------------  Output  ---------------------------------*/
 
 void WideNESModule::output() {
+  TRACE_SCOPE("WideNESModule::output");
+
   // calculate origin (where to render NES screen / where to offset tiles from)
   const int nes_w = 256 * this->pan.zoom;
   const int nes_h = 240 * this->pan.zoom;
@@ -981,5 +989,6 @@ void WideNESModule::output() {
 
   this->menu_submodule->output();
 
+  TRACE_SCOPE("WideNESModule::present");
   SDL_RenderPresent(this->sdl.renderer);
 }
@@ -28,7 +28,15 @@ FM2_Replay::FM2_Replay() {
 bool FM2_Replay::init(const char* filename, bool lazy) {
   (void)lazy; // TODO: lazy-loading FM2
 
-  ANESE_fs::load::load_file(filename, this->fm2, this->fm2_len);
+  u8* data; uint data_len;
+  if (ANESE_fs::load::load_file(filename, data, data_len)) {
+    // the parser relies on the movie being null-terminated
+    this->fm2 = new u8 [data_len + 1];
+    memcpy(this->fm2, data, data_len);
+    this->fm2[data_len] = '\0';
+    this->fm2_len = data_len;
+    delete[] data;
+  }
 
   bool did_parse = this->parse_fm2_header();
 
@@ -5,6 +5,7 @@
 #include <SDL.h>
 
 #include "config.h"
+#include "util/triple_buffer.h"
 
 #include "nes/cartridge/cartridge.h"
 #include "nes/nes.h"
@@ -17,8 +18,9 @@ struct SDL_Common {
 };
 
 struct GUIStatus {
-  bool in_menu = true;
-  uint avg_fps = 60;
+  SDL_atomic_t in_menu { true };
+  SDL_atomic_t avg_fps { 60 }; // updated from the emulation thread
+  SDL_atomic_t speed { 100 };  // what speed the NES last ran at
 };
 
 struct SharedState {
@@ -29,6 +31,9 @@ struct SharedState {
   NES_Params& nes_params;
   NES& nes;
 
+  // Finished frames, handed off from emulation -> presentation
+  TripleBuffer<u8, 256 * 240 * 4> frames;
+
   Cartridge* cart = nullptr;
   const Serializable::Chunk* savestate [4] = { nullptr };
 
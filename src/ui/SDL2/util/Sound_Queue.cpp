@@ -6,6 +6,8 @@
 #include <assert.h>
 #include <string.h>
 
+#include "common/trace.h"
+
 /* Copyright (C) 2005 by Shay Green. Permission is hereby granted, free of
 charge, to any person obtaining a copy of this software module and associated
 documentation files (the "Software"), to deal in the Software without
@@ -97,6 +99,7 @@ inline Sound_Queue::sample_t* Sound_Queue::buf( int index )
 
 void Sound_Queue::write( const sample_t* in, int count )
 {
+	TRACE_SCOPE( "Sound_Queue::write" );
 	while ( count )
 	{
 		int n = buf_size - write_pos;
@@ -0,0 +1,106 @@
+#include "cpu_trace_writer.h"
+
+#include <cinttypes>
+#include <cstring>
+
+CPU_TraceWriter::~CPU_TraceWriter() {
+  this->stop();
+}
+
+bool CPU_TraceWriter::start(const char* path, const CPU_TraceRing& ring) {
+  this->stop();
+
+  this->file = fopen(path, "wb");
+  if (!this->file) {
+    fprintf(stderr, "[CPU Trace] Could not open '%s' for writing!\n", path);
+    return false;
+  }
+
+  CPU_TraceFileHeader header;
+  memcpy(header.magic, "ANESECPU", 8);
+  header.version = CPU_TraceFileHeader::VERSION;
+  header.entry_size = sizeof(CPU_TraceEntry);
+  fwrite(&header, sizeof header, 1, this->file);
+
+  this->ring = &ring;
+  this->pos = ring.written();
+  this->dropped = 0;
+
+  this->running = true;
+  this->thread = SDL_CreateThread(CPU_TraceWriter::thread_main,
+                                  "cpu_trace", this);
+  if (!this->thread) {
+    fprintf(stderr, "[CPU Trace] Could not create writer thread: %s\n",
+      SDL_GetError());
+    fclose(this->file);
+    this->file = nullptr;
+    return false;
+  }
+
+  fprintf(stderr, "[CPU Trace] Writing trace to '%s'\n", path);
+  return true;
+}
+
+void CPU_TraceWriter::stop() {
+  if (!this->thread) return;
+
+  this->running = false;
+  SDL_WaitThread(this->thread, nullptr);
+  this->thread = nullptr;
+
+  this->drain(); // pick up any stragglers
+
+  fclose(this->file);
+  this->file = nullptr;
+
+  if (this->dropped)
+    fprintf(stderr, "[CPU Trace] Writer fell behind, dropped %" PRIu64
+                    " instructions!\n", this->dropped);
+}
+
+int CPU_TraceWriter::thread_main(void* self) {
+  CPU_TraceWriter& writer = *(CPU_TraceWriter*)self;
+  while (writer.running) {
+    writer.drain();
+    SDL_Delay(1);
+  }
+  return 0;
+}
+
+void CPU_TraceWriter::drain() {
+  const CPU_TraceRing& ring = *this->ring;
+
+  // copy entries out of the ring a chunk at a time, so the file is written in
+  // big blocks (and the ring is read as quickly as possible)
+  static constexpr uint CHUNK = 4096;
+  CPU_TraceEntry chunk [CHUNK];
+
+  for (;;) {
+    u64 end = ring.written();
+    if (end == this->pos) return;
+
+    // anything more than a ring's length behind has already been overwritten
+    if (end - this->pos > ring.size()) {
+      this->dropped += end - ring.size() - this->pos;
+      this->pos = end - ring.size();
+    }
+
+    if (end - this->pos > CHUNK) end = this->pos + CHUNK;
+    for (u64 i = this->pos; i < end; i++)
+      chunk[i - this->pos] = ring[i];
+
+    // the CPU might have lapped us while we were copying (and it might be
+    // halfway through overwriting the oldest entry)
+    u64 start = this->pos;
+    const u64 written = ring.written();
+    if (written - start >= ring.size()) {
+      const u64 oldest = written - ring.size() + 1;
+      start = oldest < end ? oldest : end;
+      this->dropped += start - this->pos;
+    }
+
+    fwrite(chunk + (start - this->pos), sizeof(CPU_TraceEntry),
+      end - start, this->file);
+    this->pos = end;
+  }
+}
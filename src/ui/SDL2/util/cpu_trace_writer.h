@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <cstdio>
+
+#include <SDL.h>
+
+#include "common/util.h"
+#include "nes/cpu/trace.h"
+
+// Drains a CPU_TraceRing into a binary trace file, on a background thread.
+// The file can be formatted (into the nestest log format) with anese_cpu_trace.
+//
+// If the writer falls too far behind the CPU, the entries that got overwritten
+// in the meantime are skipped (and counted, see dropped()).
+class CPU_TraceWriter final {
+private:
+  const CPU_TraceRing* ring = nullptr;
+  FILE* file = nullptr;
+
+  u64 pos = 0;     // next entry to write
+  u64 dropped = 0; // # of entries lost to overruns
+
+  SDL_Thread* thread = nullptr;
+  std::atomic<bool> running { false };
+
+  static int thread_main(void* self);
+  void drain();
+
+public:
+  ~CPU_TraceWriter();
+  CPU_TraceWriter() = default;
+
+  CPU_TraceWriter(const CPU_TraceWriter&) = delete;
+  CPU_TraceWriter& operator=(const CPU_TraceWriter&) = delete;
+
+  // Starts writing new entries (i.e: ones pushed after this call)
+  bool start(const char* path, const CPU_TraceRing& ring);
+  // Writes out the remaining entries, and closes the file.
+  // The ring must not be pushed to while stopping.
+  void stop();
+
+  bool is_running() const { return this->thread != nullptr; }
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstring>
+
+#include <SDL.h>
+
+#include "common/util.h"
+
+// Lock-free single-producer / single-consumer triple buffer.
+//
+// The producer always has a buffer to write into, and the consumer always
+// gets the most recently published buffer, without either side ever blocking
+// (or seeing a half-written buffer).
+//
+// Three buffers get passed around:
+// - back:   owned by the producer (being written to)
+// - middle: the most recently published buffer (up for grabs)
+// - front:  owned by the consumer (being read from)
+// publish() swaps back <-> middle, and update() swaps middle <-> front.
+template <typename T, uint len>
+class TripleBuffer {
+private:
+  T buffers [3][len];
+
+  // index of the middle buffer, with a flag set if it hasn't been read yet
+  enum { FRESH = 0x4 };
+  SDL_atomic_t middle;
+
+  int back;
+  int front;
+
+public:
+  TripleBuffer() : back(0), front(1) {
+    SDL_AtomicSet(&this->middle, 2);
+    memset(this->buffers, 0, sizeof this->buffers);
+  }
+
+  // ---- Producer ---- //
+  T* write_buffer() { return this->buffers[this->back]; }
+  void publish() {
+    this->back = SDL_AtomicSet(&this->middle, this->back | FRESH) & ~FRESH;
+  }
+
+  // ---- Consumer ---- //
+  const T* read_buffer() const { return this->buffers[this->front]; }
+  // Grabs the most recently published buffer (if there is one).
+  // Returns false if nothing new has been published since the last update.
+  bool update() {
+    if (!(SDL_AtomicGet(&this->middle) & FRESH)) return false;
+    this->front = SDL_AtomicSet(&this->middle, this->front) & ~FRESH;
+    return true;
+  }
+};
@@ -0,0 +1,481 @@
+// Component micro-benchmarks
+// Times the core's hot paths in isolation (CPU instructions, PPU dots, APU
+// cycles, MMC3 A12 handling, savestates), on synthetic ROMs that are built in
+// memory, so there's nothing to download and the numbers are comparable across
+// machines / commits.
+//
+// Every benchmark runs `--warmup` untimed samples, followed by `--iters` timed
+// samples of a fixed number of ops each. Heap allocations are counted by
+// hooking the global operator new.
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <clara.hpp>
+
+#include "nes/cartridge/cartridge.h"
+#include "nes/cartridge/parse_rom.h"
+#include "nes/joy/controllers/standard.h"
+#include "nes/nes.h"
+#include "nes/params.h"
+
+using Clock = std::chrono::steady_clock;
+
+/*-----------------------------  Allocations  ------------------------------*/
+
+static u64 g_allocs = 0;
+static u64 g_alloc_bytes = 0;
+
+static void* counted_malloc(size_t size) {
+  g_allocs++;
+  g_alloc_bytes += size;
+  void* p = malloc(size ? size : 1);
+  if (!p) abort();
+  return p;
+}
+
+void* operator new  (size_t size) { return counted_malloc(size); }
+void* operator new[](size_t size) { return counted_malloc(size); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+/*----------------------------  Synthetic ROMs  ----------------------------*/
+
+// deterministic filler for CHR / RAM / OAM
+static u32 xorshift(u32& s) {
+  s ^= s << 13;
+  s ^= s >> 17;
+  s ^= s << 5;
+  return s;
+}
+
+// NROM: 16K PRG, 8K CHR (code lives at $E000, like the other ROMs)
+// A loop with a mix of loads / stores / ALU ops / branches / JSR / RTS.
+// It writes to RAM, so the CPU's idle loop detection never kicks in.
+static const u8 nrom_prg [] = {
+  /* $E000 */ 0x78,             // SEI
+  /* $E001 */ 0xD8,             // CLD
+  /* $E002 */ 0xA2, 0xFF,       // LDX #$FF
+  /* $E004 */ 0x9A,             // TXS
+  // loop:
+  /* $E005 */ 0xA5, 0x00,       // LDA $00
+  /* $E007 */ 0x18,             // CLC
+  /* $E008 */ 0x69, 0x03,       // ADC #$03
+  /* $E00A */ 0x85, 0x00,       // STA $00
+  /* $E00C */ 0xA6, 0x01,       // LDX $01
+  /* $E00E */ 0xE8,             // INX
+  /* $E00F */ 0x86, 0x01,       // STX $01
+  /* $E011 */ 0xBD, 0x00, 0x02, // LDA $0200,X
+  /* $E014 */ 0x49, 0x5A,       // EOR #$5A
+  /* $E016 */ 0x9D, 0x00, 0x03, // STA $0300,X
+  /* $E019 */ 0x0A,             // ASL A
+  /* $E01A */ 0x25, 0x00,       // AND $00
+  /* $E01C */ 0x09, 0x11,       // ORA #$11
+  /* $E01E */ 0xA8,             // TAY
+  /* $E01F */ 0xB1, 0x10,       // LDA ($10),Y
+  /* $E021 */ 0xC9, 0x80,       // CMP #$80
+  /* $E023 */ 0x90, 0x02,       // BCC +2
+  /* $E025 */ 0xEA,             // NOP
+  /* $E026 */ 0xEA,             // NOP
+  /* $E027 */ 0x20, 0x2D, 0xE0, // JSR sub
+  /* $E02A */ 0x4C, 0x05, 0xE0, // JMP loop
+  // sub:
+  /* $E02D */ 0xE6, 0x02,       // INC $02
+  /* $E02F */ 0x4A,             // LSR A
+  /* $E030 */ 0x60,             // RTS
+  // irq / nmi:
+  /* $E031 */ 0x40,             // RTI
+};
+
+// MMC3: 32K PRG, 8K CHR
+// Just spins in the fixed bank, since only the PPU side gets exercised.
+static const u8 mmc3_prg [] = {
+  /* $E000 */ 0x4C, 0x00, 0xE0, // JMP $E000
+  /* $E003 */ 0x40,             // RTI
+};
+
+// Assembles an iNES image, with the code at the start of the last 8K of PRG
+// (i.e: $E000), and the vectors pointing at `reset` / `irq`
+static ROM_File* make_rom(u8 mapper, uint prg_len, const u8* code, uint code_len,
+                          u16 reset, u16 irq) {
+  const uint chr_len = 0x2000;
+  const uint len = 0x10 + prg_len + chr_len;
+  u8* data = new u8 [len];
+  memset(data, 0, len);
+
+  u8* header = data;
+  memcpy(header, "NES\x1A", 4);
+  header[4] = prg_len / 0x4000;
+  header[5] = chr_len / 0x2000;
+  header[6] = u8((mapper & 0x0F) << 4) | 0x01; // vertical mirroring
+  header[7] = u8(mapper & 0xF0);
+
+  u8* prg = data + 0x10;
+  u8* last = prg + prg_len - 0x2000; // last 8K, where the code goes
+  memcpy(last, code, code_len);
+  const u16 vectors [3] = { irq, reset, irq }; // NMI, RESET, IRQ
+  for (uint i = 0; i < 3; i++) {
+    last[0x1FFA + i * 2 + 0] = vectors[i] & 0xFF;
+    last[0x1FFA + i * 2 + 1] = vectors[i] >> 8;
+  }
+
+  u32 seed = 0xDEB061;
+  u8* chr = prg + prg_len;
+  for (uint i = 0; i < chr_len; i++) chr[i] = xorshift(seed);
+
+  ROM_File* rom_file = parseROM(data, len);
+  if (!rom_file) delete[] data;
+  return rom_file;
+}
+
+static NES_Params bench_params() {
+  NES_Params params {};
+  params.apu_sample_rate = 44100;
+  params.speed = 100;
+  return params;
+}
+
+// An NES with a cart plugged in, powered on
+struct Machine {
+  NES_Params params = bench_params();
+  Cartridge cart;
+  NES nes;
+  JOY_Standard joy [2] { { "P1" }, { "P2" } };
+
+  Machine(ROM_File* rom_file)
+  : cart(rom_file)
+  , nes(this->params)
+  {
+    if (this->cart.status() != Cartridge::Status::CART_NO_ERROR) {
+      fprintf(stderr, "[Bench] Could not load synthetic ROM\n");
+      exit(1);
+    }
+    this->nes.attach_joy(0, &this->joy[0]);
+    this->nes.attach_joy(1, &this->joy[1]);
+    this->nes.loadCartridge(this->cart.get_mapper());
+    this->nes.power_cycle();
+  }
+
+  // Turns PPU rendering on / off, with random nametables and sprites so that
+  // there's actually something to draw
+  void setup_ppu(u8 ctrl, u8 mask) {
+    PPU& ppu = this->nes._ppu();
+    u32 seed = 0x2A03;
+
+    ppu.write(0x2000, 0x00);
+    ppu.write(0x2001, 0x00);
+    ppu.read(0x2002); // reset the address latch
+    ppu.write(0x2006, 0x20);
+    ppu.write(0x2006, 0x00);
+    for (uint i = 0; i < 0x800; i++) ppu.write(0x2007, xorshift(seed));
+    ppu.write(0x2006, 0x3F);
+    ppu.write(0x2006, 0x00);
+    for (uint i = 0; i < 0x20; i++) ppu.write(0x2007, xorshift(seed) & 0x3F);
+
+    ppu.write(0x2003, 0x00);
+    for (uint i = 0; i < 0x100; i++) ppu.write(0x2004, xorshift(seed));
+
+    ppu.write(0x2005, 0x00);
+    ppu.write(0x2005, 0x00);
+    ppu.write(0x2000, ctrl);
+    ppu.write(0x2001, mask);
+  }
+};
+
+/*-------------------------------  Benchmarks  -----------------------------*/
+
+struct Fixture {
+  Machine* nrom;
+  Machine* mmc3;
+
+  // savestate scratch space
+  std::vector<u8> state;
+};
+
+struct Bench {
+  const char* name;
+  const char* unit;  // what a single op is
+  uint ops;          // ops per sample
+  void (*setup)(Fixture& fx);
+  void (*run)(Fixture& fx, uint ops);
+};
+
+static const Bench benches [] = {
+  { "cpu.step", "instr", 200000,
+    [](Fixture& fx) { fx.nrom->nes.power_cycle(); },
+    [](Fixture& fx, uint ops) {
+      CPU& cpu = fx.nrom->nes._cpu();
+      for (uint i = 0; i < ops; i++) cpu.step();
+    } },
+  { "ppu.dot.rendering_off", "dot", 500000,
+    [](Fixture& fx) { fx.nrom->setup_ppu(0x00, 0x00); },
+    [](Fixture& fx, uint ops) {
+      PPU& ppu = fx.nrom->nes._ppu();
+      for (uint i = 0; i < ops; i++) ppu.cycle();
+    } },
+  { "ppu.dot.rendering_on", "dot", 500000,
+    [](Fixture& fx) { fx.nrom->setup_ppu(0x00, 0x1E); },
+    [](Fixture& fx, uint ops) {
+      PPU& ppu = fx.nrom->nes._ppu();
+      for (uint i = 0; i < ops; i++) ppu.cycle();
+    } },
+  { "apu.cycle", "cycle", 500000,
+    [](Fixture& fx) {
+      // every channel on, with some tone / noise going
+      APU& apu = fx.nrom->nes._apu();
+      apu.write(0x4015, 0x1F);
+      apu.write(0x4000, 0xBF); apu.write(0x4002, 0xFD); apu.write(0x4003, 0x08);
+      apu.write(0x4004, 0x7F); apu.write(0x4006, 0x7E); apu.write(0x4007, 0x09);
+      apu.write(0x4008, 0xFF); apu.write(0x400A, 0x40); apu.write(0x400B, 0x08);
+      apu.write(0x400C, 0x3F); apu.write(0x400E, 0x04); apu.write(0x400F, 0x08);
+    },
+    [](Fixture& fx, uint ops) {
+      APU& apu = fx.nrom->nes._apu();
+      float* samples; uint len;
+      for (uint i = 0; i < ops; i++) {
+        apu.cycle();
+        // drain the sample buffer about as often as the frontends do
+        if (i % 29780 == 0) apu.getAudiobuff(&samples, &len);
+      }
+    } },
+  { "mmc3.a12", "read", 1000000,
+    [](Fixture& fx) {
+      // IRQ every 8 scanlines
+      CPU_MMU& mmu = fx.mmc3->nes._cpu_mmu();
+      mmu.write(0xC000, 7);
+      mmu.write(0xC001, 0);
+      mmu.write(0xE001, 0);
+    },
+    [](Fixture& fx, uint ops) {
+      // Same pattern as a scanline's worth of fetches with the background at
+      // $0000 and sprites at $1000: 64 reads with A12 low, then 16 with it high
+      Mapper& mapper = *fx.mmc3->cart.get_mapper();
+      for (uint i = 0; i < ops; i++) {
+        const uint j = i % 80;
+        const u16 addr = j < 64 ? (j * 8) & 0x0FFF : 0x1000 | (j * 16);
+        mapper.read(addr);
+      }
+    } },
+  { "mmc3.ppu.dot", "dot", 500000,
+    [](Fixture& fx) {
+      CPU_MMU& mmu = fx.mmc3->nes._cpu_mmu();
+      mmu.write(0xC000, 7);
+      mmu.write(0xC001, 0);
+      mmu.write(0xE001, 0);
+      fx.mmc3->setup_ppu(0x08, 0x1E); // sprites at $1000
+    },
+    [](Fixture& fx, uint ops) {
+      PPU& ppu = fx.mmc3->nes._ppu();
+      for (uint i = 0; i < ops; i++) ppu.cycle();
+    } },
+  { "nes.frame", "frame", 20,
+    [](Fixture& fx) { fx.nrom->setup_ppu(0x80, 0x1E); },
+    [](Fixture& fx, uint ops) {
+      for (uint i = 0; i < ops; i++) fx.nrom->nes.step_frame();
+    } },
+  { "serialize", "state", 200,
+    nullptr,
+    [](Fixture& fx, uint ops) {
+      for (uint i = 0; i < ops; i++)
+        delete fx.nrom->nes.serialize();
+    } },
+  { "serialize.collate", "state", 200,
+    nullptr,
+    [](Fixture& fx, uint ops) {
+      for (uint i = 0; i < ops; i++) {
+        Serializable::Chunk* chunk = fx.nrom->nes.serialize();
+        const u8* data; uint len;
+        Serializable::Chunk::collate(data, len, chunk);
+        delete chunk;
+        delete[] data;
+      }
+    } },
+  { "deserialize", "state", 200,
+    nullptr,
+    [](Fixture& fx, uint ops) {
+      Serializable::Chunk* chunk = fx.nrom->nes.serialize();
+      for (uint i = 0; i < ops; i++)
+        fx.nrom->nes.deserialize(chunk);
+      delete chunk;
+    } },
+  { "deserialize.parse", "state", 200,
+    nullptr,
+    [](Fixture& fx, uint ops) {
+      Serializable::Chunk* chunk = fx.nrom->nes.serialize();
+      const u8* data; uint len;
+      Serializable::Chunk::collate(data, len, chunk);
+      delete chunk;
+      for (uint i = 0; i < ops; i++) {
+        const Serializable::Chunk* parsed = Serializable::Chunk::parse(data, len);
+        fx.nrom->nes.deserialize(parsed);
+        delete parsed;
+      }
+      delete[] data;
+    } },
+  { "save_state", "state", 2000,
+    [](Fixture& fx) { fx.state.resize(fx.nrom->nes.state_size()); },
+    [](Fixture& fx, uint ops) {
+      for (uint i = 0; i < ops; i++) fx.nrom->nes.save_state(fx.state.data());
+    } },
+  { "load_state", "state", 2000,
+    [](Fixture& fx) {
+      fx.state.resize(fx.nrom->nes.state_size());
+      fx.nrom->nes.save_state(fx.state.data());
+    },
+    [](Fixture& fx, uint ops) {
+      for (uint i = 0; i < ops; i++) fx.nrom->nes.load_state(fx.state.data());
+    } },
+};
+
+/*--------------------------------  Running  -------------------------------*/
+
+struct Result {
+  const Bench* bench;
+  uint ops;             // ops per sample
+  double min_ns;        // per op
+  double median_ns;     // per op
+  double mean_ns;       // per op
+  double allocs;        // per op
+  double alloc_bytes;   // per op
+};
+
+static Result run_bench(const Bench& bench, Fixture& fx,
+                        uint warmup, uint iters, double scale) {
+  Result r {};
+  r.bench = &bench;
+  r.ops = std::max(1u, uint(bench.ops * scale));
+
+  if (bench.setup) bench.setup(fx);
+  for (uint i = 0; i < warmup; i++) bench.run(fx, r.ops);
+
+  std::vector<double> samples;
+  samples.reserve(iters); // so it doesn't show up in the allocation counts
+  const u64 allocs = g_allocs, alloc_bytes = g_alloc_bytes;
+  for (uint i = 0; i < iters; i++) {
+    const auto start = Clock::now();
+    bench.run(fx, r.ops);
+    const auto end = Clock::now();
+    samples.push_back(std::chrono::duration<double, std::nano>(end - start)
+      .count() / r.ops);
+  }
+  const double total_ops = double(r.ops) * iters;
+  r.allocs      = (g_allocs      - allocs)      / total_ops;
+  r.alloc_bytes = (g_alloc_bytes - alloc_bytes) / total_ops;
+
+  std::sort(samples.begin(), samples.end());
+  r.min_ns = samples.front();
+  r.median_ns = iters % 2
+    ? samples[iters / 2]
+    : (samples[iters / 2 - 1] + samples[iters / 2]) / 2;
+  r.mean_ns = 0;
+  for (double s : samples) r.mean_ns += s;
+  r.mean_ns /= iters;
+
+  return r;
+}
+
+int main(int argc, char* argv[]) {
+  uint warmup = 2;
+  uint iters = 10;
+  double scale = 1.0;
+  std::string filter;
+  std::string format = "text";
+  bool list = false;
+
+  bool show_help = false;
+  auto cli
+    = clara::Help(show_help)
+    | clara::Opt(warmup, "n")
+        ["--warmup"]
+        ("untimed samples to run first (default: 2)")
+    | clara::Opt(iters, "n")
+        ["--iters"]
+        ("timed samples per benchmark (default: 10)")
+    | clara::Opt(scale, "x")
+        ["--scale"]
+        ("multiply the # of ops per sample (default: 1.0)")
+    | clara::Opt(filter, "substring")
+        ["--filter"]
+        ("only run benchmarks whose name contains the given substring")
+    | clara::Opt(format, "text|json|csv")
+        ["--format"]
+        ("output format (default: text)")
+    | clara::Opt(list)
+        ["--list"]
+        ("list the benchmarks, and exit");
+
+  auto result = cli.parse(clara::Args(argc, argv));
+  if (!result || show_help || iters == 0 || scale <= 0
+      || (format != "text" && format != "json" && format != "csv")) {
+    if (!result) fprintf(stderr, "Error: %s\n", result.errorMessage().c_str());
+    std::cerr << cli;
+    return 1;
+  }
+
+  if (list) {
+    for (const Bench& bench : benches)
+      printf("%-24s %8u %s(s) per sample\n", bench.name, bench.ops, bench.unit);
+    return 0;
+  }
+
+  Fixture fx;
+  fx.nrom = new Machine (make_rom(0, 0x4000, nrom_prg, sizeof nrom_prg,
+                                  0xE000, 0xE031));
+  fx.mmc3 = new Machine (make_rom(4, 0x8000, mmc3_prg, sizeof mmc3_prg,
+                                  0xE000, 0xE003));
+
+  // run the NROM machine for a bit, so savestates have something in them
+  for (uint i = 0; i < 10; i++) fx.nrom->nes.step_frame();
+
+  std::vector<Result> results;
+  for (const Bench& bench : benches) {
+    if (!filter.empty() && !strstr(bench.name, filter.c_str())) continue;
+    results.push_back(run_bench(bench, fx, warmup, iters, scale));
+    if (format == "text") {
+      const Result& r = results.back();
+      printf("%-24s %10.2f ns/%-6s %14.0f %s/s  (min %.2f, mean %.2f)"
+             "  %.3f allocs/%s (%.0f B)\n",
+        bench.name, r.median_ns, bench.unit, 1e9 / r.median_ns, bench.unit,
+        r.min_ns, r.mean_ns, r.allocs, bench.unit, r.alloc_bytes);
+      fflush(stdout);
+    }
+  }
+
+  if (format == "json") {
+    printf("{\n  \"warmup\": %u,\n  \"iters\": %u,\n  \"benchmarks\": [\n",
+      warmup, iters);
+    for (size_t i = 0; i < results.size(); i++) {
+      const Result& r = results[i];
+      printf("    { \"name\": \"%s\", \"unit\": \"%s\", \"ops\": %u, "
+             "\"min_ns\": %.3f, \"median_ns\": %.3f, \"mean_ns\": %.3f, "
+             "\"ops_per_sec\": %.1f, \"allocs\": %.4f, \"alloc_bytes\": %.1f }%s\n",
+        r.bench->name, r.bench->unit, r.ops,
+        r.min_ns, r.median_ns, r.mean_ns, 1e9 / r.median_ns,
+        r.allocs, r.alloc_bytes,
+        i + 1 < results.size() ? "," : "");
+    }
+    printf("  ]\n}\n");
+  } else if (format == "csv") {
+    printf("name,unit,ops,min_ns,median_ns,mean_ns,ops_per_sec,allocs,alloc_bytes\n");
+    for (const Result& r : results) {
+      printf("%s,%s,%u,%.3f,%.3f,%.3f,%.1f,%.4f,%.1f\n",
+        r.bench->name, r.bench->unit, r.ops,
+        r.min_ns, r.median_ns, r.mean_ns, 1e9 / r.median_ns,
+        r.allocs, r.alloc_bytes);
+    }
+  }
+
+  delete fx.nrom;
+  delete fx.mmc3;
+  return 0;
+}
@@ -0,0 +1,81 @@
+// CPU trace formatter
+// Turns a binary CPU trace (as recorded by `anese --log-cpu <path>`) into the
+// nestest golden log format, optionally tacking on the PPU's position.
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include <clara.hpp>
+
+#include "nes/cpu/trace.h"
+
+int main(int argc, char* argv[]) {
+  std::string path;
+  bool ppu = false;
+  uint skip = 0;
+  uint count = 0;
+
+  bool show_help = false;
+  auto cli
+    = clara::Help(show_help)
+    | clara::Opt(ppu)
+        ["--ppu"]
+        ("append the PPU scanline / dot to each line")
+    | clara::Opt(skip, "n")
+        ["--skip"]
+        ("skip the first n instructions")
+    | clara::Opt(count, "n")
+        ["--count"]
+        ("only output n instructions (default: all of them)")
+    | clara::Arg(path, "trace")
+        ("a binary CPU trace");
+
+  auto result = cli.parse(clara::Args(argc, argv));
+  if (!result || path.empty() || show_help) {
+    if (!result) fprintf(stderr, "Error: %s\n", result.errorMessage().c_str());
+    std::cerr << cli;
+    return 1;
+  }
+
+  FILE* f = fopen(path.c_str(), "rb");
+  if (!f) {
+    fprintf(stderr, "[CPU Trace] Could not open '%s'\n", path.c_str());
+    return 1;
+  }
+
+  CPU_TraceFileHeader header;
+  if (fread(&header, sizeof header, 1, f) != 1
+      || memcmp(header.magic, "ANESECPU", 8) != 0) {
+    fprintf(stderr, "[CPU Trace] '%s' is not a CPU trace\n", path.c_str());
+    fclose(f);
+    return 1;
+  }
+  if (header.version != CPU_TraceFileHeader::VERSION
+      || header.entry_size != sizeof(CPU_TraceEntry)) {
+    fprintf(stderr, "[CPU Trace] Unsupported trace version (v%u, %u bytes)\n",
+      header.version, header.entry_size);
+    fclose(f);
+    return 1;
+  }
+
+  fseek(f, long(sizeof header + u64(skip) * sizeof(CPU_TraceEntry)), SEEK_SET);
+
+  static CPU_TraceEntry entries [4096];
+  char line [CPU_TraceEntry::NESTEST_LEN];
+
+  uint n = 0;
+  while (size_t len = fread(entries, sizeof entries[0], 4096, f)) {
+    for (size_t i = 0; i < len; i++) {
+      if (count && n++ == count) { fclose(f); return 0; }
+
+      const CPU_TraceEntry& e = entries[i];
+      e.to_nestest(line);
+      if (ppu) printf("%s SL:%3u DOT:%3u\n", line, e.scanline, e.dot);
+      else     printf("%s\n", line);
+    }
+  }
+
+  fclose(f);
+  return 0;
+}
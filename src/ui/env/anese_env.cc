@@ -0,0 +1,261 @@
+#include "anese_env.h"
+
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "obs.h"
+#include "thread_pool.h"
+
+#include "nes/cartridge/cartridge.h"
+#include "nes/cartridge/parse_rom.h"
+#include "nes/joy/controllers/standard.h"
+#include "nes/nes.h"
+#include "nes/params.h"
+
+struct anese_env {
+  NES_Params params {};
+  Cartridge* cart = nullptr;
+
+  // The first instance runs off the Cartridge's mapper. The rest are clones,
+  // which own their mappers.
+  std::vector<NES*> nes;
+  std::vector<JOY_Standard*> joy;
+
+  // flat savestate (see NES::save_state)
+  std::vector<u8> reset_state;
+
+  ObsKernel* obs = nullptr;
+
+  ThreadPool* pool = nullptr;
+
+  ~anese_env() {
+    delete this->pool;
+    delete this->obs;
+    for (NES* nes : this->nes) delete nes;
+    for (JOY_Standard* joy : this->joy) delete joy;
+    delete this->cart;
+  }
+};
+
+/*----------  Jobs  ----------*/
+
+namespace {
+
+struct StepJob {
+  anese_env* env;
+  const uint8_t* actions;
+  unsigned frames;
+  uint8_t* obs;
+
+  static void run(void* self, uint i) {
+    const StepJob& job = *(StepJob*)self;
+    NES& nes = *job.env->nes[i];
+    JOY_Standard& joy = *job.env->joy[i];
+
+    for (uint b = 0; b < 8; b++) {
+      const auto btn = JOY_Standard_Button::Type(1 << b);
+      joy.set_button(btn, nth_bit(job.actions[i], b));
+    }
+
+    // Instances run in compact mode, so they don't have any framebuffers of
+    // their own. Instead, the frames that make it into the observation are
+    // rendered into per-thread scratch buffers (the rest are skipped).
+    static thread_local u8 frame [ANESE_ENV_OBS_SIZE];
+    static thread_local u8 prev  [ANESE_ENV_OBS_SIZE];
+
+    const ObsKernel& kernel = *job.env->obs;
+    const bool render = job.obs != nullptr;
+    const bool pool = render && kernel.needs_prev() && job.frames >= 2;
+
+    PPU& ppu = nes._ppu();
+    for (uint f = 0; f < job.frames; f++) {
+      if (render && f + 1 == job.frames) {
+        ppu.setFramebuffNESColorTarget(frame);
+        nes.step_frame();
+      } else if (pool && f + 2 == job.frames) {
+        ppu.setFramebuffNESColorTarget(prev);
+        nes.step_frame();
+      } else {
+        nes.skip_frame();
+      }
+    }
+    ppu.setFramebuffNESColorTarget(nullptr);
+
+    if (render)
+      kernel.run(frame, pool ? prev : frame, job.obs + i * kernel.size());
+  }
+};
+
+struct ResetJob {
+  anese_env* env;
+  const uint8_t* mask;
+
+  static void run(void* self, uint i) {
+    const ResetJob& job = *(ResetJob*)self;
+    if (job.mask && !job.mask[i]) return;
+    job.env->nes[i]->load_state(job.env->reset_state.data());
+  }
+};
+
+} // namespace
+
+/*----------  C API  ----------*/
+
+anese_env* anese_env_create(
+  const uint8_t* rom_data, size_t rom_len,
+  unsigned num_envs,
+  unsigned num_threads
+) {
+  if (!rom_data || !rom_len || !num_envs) return nullptr;
+
+  // parseROM takes ownership of the data it's given
+  u8* data = new u8 [rom_len];
+  memcpy(data, rom_data, rom_len);
+
+  Cartridge* cart = new Cartridge (parseROM(data, rom_len));
+  if (cart->status() != Cartridge::Status::CART_NO_ERROR) {
+    fprintf(stderr, "[Env] Could not load ROM\n");
+    delete cart;
+    return nullptr;
+  }
+
+  anese_env* env = new anese_env ();
+  env->cart = cart;
+
+  env->params.apu_sample_rate = 44100;
+  env->params.speed = 100;
+  env->params.compact = true;
+
+  NES* nes = new NES (env->params);
+  nes->loadCartridge(cart->get_mapper());
+  nes->power_cycle();
+  env->nes.push_back(nes);
+
+  env->reset_state.resize(nes->state_size());
+  nes->save_state(env->reset_state.data());
+  for (uint i = 1; i < num_envs; i++)
+    env->nes.push_back(nes->clone());
+
+  for (uint i = 0; i < num_envs; i++) {
+    env->joy.push_back(new JOY_Standard ("Env"));
+    env->nes[i]->attach_joy(0, env->joy[i]);
+  }
+
+  if (num_threads == 0)
+    num_threads = std::thread::hardware_concurrency();
+  if (num_threads == 0)
+    num_threads = 1;
+  if (num_threads > num_envs)
+    num_threads = num_envs;
+  env->pool = new ThreadPool (num_threads);
+
+  env->obs = new ObsKernel (ObsKernel::PALETTE, 0, 0, false);
+
+  fprintf(stderr, "[Env] Created %u instances, running on %u threads\n",
+    num_envs, num_threads);
+
+  return env;
+}
+
+void anese_env_destroy(anese_env* env) {
+  delete env;
+}
+
+unsigned anese_env_num_envs(const anese_env* env) {
+  return env->nes.size();
+}
+
+int anese_env_set_obs_format(
+  anese_env* env,
+  int format,
+  unsigned width, unsigned height,
+  int max_pool
+) {
+  ObsKernel::Format fmt;
+  switch (format) {
+  case ANESE_ENV_OBS_PALETTE:      fmt = ObsKernel::PALETTE;      break;
+  case ANESE_ENV_OBS_PALETTE_HALF: fmt = ObsKernel::PALETTE_HALF; break;
+  case ANESE_ENV_OBS_GRAY:         fmt = ObsKernel::GRAY;         break;
+  case ANESE_ENV_OBS_RGB:          fmt = ObsKernel::RGB;          break;
+  default:
+    fprintf(stderr, "[Env] Unknown observation format %d\n", format);
+    return -1;
+  }
+
+  if (!ObsKernel::is_valid(fmt, width, height, !!max_pool)) {
+    fprintf(stderr, "[Env] Invalid observation format (%d, %ux%u, pool: %d)\n",
+      format, width, height, max_pool);
+    return -1;
+  }
+
+  delete env->obs;
+  env->obs = new ObsKernel (fmt, width, height, !!max_pool);
+
+  return 0;
+}
+
+size_t anese_env_obs_size(const anese_env* env) {
+  return env->obs->size();
+}
+
+void anese_env_step(
+  anese_env* env,
+  const uint8_t* actions,
+  unsigned frames,
+  uint8_t* obs
+) {
+  if (frames == 0) return;
+
+  StepJob job { env, actions, frames, obs };
+  env->pool->parallel_for(env->nes.size(), StepJob::run, &job);
+}
+
+void anese_env_reset(anese_env* env, const uint8_t* mask) {
+  ResetJob job { env, mask };
+  env->pool->parallel_for(env->nes.size(), ResetJob::run, &job);
+}
+
+void anese_env_save_reset_state(anese_env* env, unsigned i) {
+  env->nes[i]->save_state(env->reset_state.data());
+}
+
+void anese_env_read_ram(
+  const anese_env* env,
+  const uint16_t* addrs,
+  unsigned num_addrs,
+  uint8_t* out
+) {
+  for (uint i = 0; i < env->nes.size(); i++) {
+    const Memory& mem = env->nes[i]->_cpu_mmu();
+    for (uint j = 0; j < num_addrs; j++)
+      out[i * num_addrs + j] = mem.peek(addrs[j]);
+  }
+}
+
+int anese_env_is_running(const anese_env* env, unsigned i) {
+  return env->nes[i]->isRunning();
+}
+
+int anese_env_stats(
+  const anese_env* env,
+  unsigned i,
+  int format,
+  char* buf, size_t len
+) {
+  switch (format) {
+  case ANESE_ENV_STATS_JSON: return env->nes[i]->stats().to_json(buf, len);
+  case ANESE_ENV_STATS_CSV:  return env->nes[i]->stats().to_csv(buf, len);
+  case ANESE_ENV_STATS_CSV_HEADER:
+    return snprintf(buf, len, "%s", NES_Stats::csv_header());
+  default:
+    fprintf(stderr, "[Env] Unknown stats format %d\n", format);
+    return -1;
+  }
+}
+
+void anese_env_set_profiling(anese_env* env, int enabled) {
+  // every instance shares the same params
+  env->params.profile = !!enabled;
+}
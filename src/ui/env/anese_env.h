@@ -0,0 +1,151 @@
+#ifndef ANESE_ENV_H
+#define ANESE_ENV_H
+
+/*
+ * ANESE batch environment
+ *
+ * Steps a whole batch of NES instances (all running the same ROM) in lockstep,
+ * spread across a pool of threads. Meant for things like reinforcement
+ * learning, where a training loop wants to feed in a batch of actions, and get
+ * back a batch of observations.
+ *
+ * Plain C ABI, so that it can be loaded via ctypes / cffi / whatever.
+ * None of the functions are thread-safe with respect to the same env.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Size of a raw frame of NES palette indices (0 - 63), one byte per pixel */
+#define ANESE_ENV_OBS_WIDTH  256
+#define ANESE_ENV_OBS_HEIGHT 240
+#define ANESE_ENV_OBS_SIZE   (ANESE_ENV_OBS_WIDTH * ANESE_ENV_OBS_HEIGHT)
+
+/* Action bits (same layout as the NES standard controller shift register) */
+#define ANESE_ENV_BTN_A      0x01
+#define ANESE_ENV_BTN_B      0x02
+#define ANESE_ENV_BTN_SELECT 0x04
+#define ANESE_ENV_BTN_START  0x08
+#define ANESE_ENV_BTN_UP     0x10
+#define ANESE_ENV_BTN_DOWN   0x20
+#define ANESE_ENV_BTN_LEFT   0x40
+#define ANESE_ENV_BTN_RIGHT  0x80
+
+/* Observation formats (see anese_env_set_obs_format) */
+#define ANESE_ENV_OBS_PALETTE      0 /* 256x240x1 palette indices (default) */
+#define ANESE_ENV_OBS_PALETTE_HALF 1 /* 128x120x1 palette indices */
+#define ANESE_ENV_OBS_GRAY         2 /* WxHx1 grayscale */
+#define ANESE_ENV_OBS_RGB          3 /* WxHx3 RGB */
+
+/* Stats formats (see anese_env_stats) */
+#define ANESE_ENV_STATS_JSON       0 /* a single JSON object */
+#define ANESE_ENV_STATS_CSV        1 /* a single CSV row */
+#define ANESE_ENV_STATS_CSV_HEADER 2 /* the CSV header row */
+
+typedef struct anese_env anese_env;
+
+/*
+ * Creates num_envs powered-on instances of the given ROM (the data is copied).
+ * num_threads == 0 uses one thread per hardware thread.
+ * Returns NULL if the ROM couldn't be loaded.
+ */
+anese_env* anese_env_create(
+  const uint8_t* rom_data, size_t rom_len,
+  unsigned num_envs,
+  unsigned num_threads
+);
+void anese_env_destroy(anese_env* env);
+
+unsigned anese_env_num_envs(const anese_env* env);
+
+/*
+ * Sets the format of the observations returned by anese_env_step.
+ * width / height are only used by the GRAY and RGB formats, which area-average
+ * the frame down to (at most) 256x240. Pixels are row-major, channels
+ * interleaved.
+ * If max_pool != 0, every pixel is the per-channel max of the last 2 frames
+ * of a step (before downscaling), which gets rid of sprite flicker. Not
+ * supported for the palette index formats, and a no-op when stepping 1 frame.
+ * Returns 0 on success, or -1 if the format is invalid (leaving it unchanged).
+ */
+int anese_env_set_obs_format(
+  anese_env* env,
+  int format,
+  unsigned width, unsigned height,
+  int max_pool
+);
+
+/* Size of a single instance's observation, in bytes */
+size_t anese_env_obs_size(const anese_env* env);
+
+/*
+ * Steps every instance by `frames` (>= 1) frames, holding down the buttons in
+ * actions[i] (one byte per instance, see ANESE_ENV_BTN_XXX).
+ * Only the last frame is rendered (the rest are run in frameskip mode), or the
+ * last 2 frames, when max-pooling. Nothing is rendered if obs is NULL.
+ * If obs isn't NULL, it must hold num_envs * anese_env_obs_size() bytes, and
+ * gets filled with each instance's observation, back-to-back.
+ */
+void anese_env_step(
+  anese_env* env,
+  const uint8_t* actions,
+  unsigned frames,
+  uint8_t* obs
+);
+
+/*
+ * Resets instances back to the cached reset state.
+ * If mask isn't NULL, only instances with mask[i] != 0 get reset.
+ * The reset state is initially the power-on state.
+ */
+void anese_env_reset(anese_env* env, const uint8_t* mask);
+
+/* Replaces the cached reset state with instance i's current state */
+void anese_env_save_reset_state(anese_env* env, unsigned i);
+
+/*
+ * Reads num_addrs bytes from the CPU address space of every instance (without
+ * side effects), writing them to out[i * num_addrs + j].
+ * Handy for computing rewards from RAM.
+ */
+void anese_env_read_ram(
+  const anese_env* env,
+  const uint16_t* addrs,
+  unsigned num_addrs,
+  uint8_t* out
+);
+
+/* Returns 0 if instance i has crashed (i.e: hit an invalid opcode) */
+int anese_env_is_running(const anese_env* env, unsigned i);
+
+/*
+ * Writes instance i's emulation counters (instructions, cycles, PPU dots, bus
+ * accesses per region, bank switches, IRQs / NMIs, etc...) to buf, as a single
+ * line of JSON or CSV (see ANESE_ENV_STATS_XXX, and NES_Stats in
+ * src/nes/stats.h). Counters are cumulative, so call this after every step and
+ * diff them to get per-step numbers.
+ * Same semantics as snprintf: returns the length of the full line, which may
+ * be truncated if it doesn't fit in len bytes. Returns -1 on a bad format.
+ */
+int anese_env_stats(
+  const anese_env* env,
+  unsigned i,
+  int format,
+  char* buf, size_t len
+);
+
+/*
+ * Enables / disables timing how long each subsystem (CPU, APU, PPU) takes,
+ * for every instance (off by default). Costs a bit of speed.
+ */
+void anese_env_set_profiling(anese_env* env, int enabled);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ANESE_ENV_H */
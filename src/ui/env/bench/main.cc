@@ -0,0 +1,172 @@
+// Batch environment throughput benchmark
+// Times anese_env_step through the C ABI (just like a training loop would),
+// and reports environment frames per second:
+//   - 1 instance on 1 thread, skipping every frame (no observations)
+//   - 1 instance on 1 thread, with an observation every step
+//   - the whole batch, spread across every thread
+// Instances run in compact mode, and every step runs --skip frames, only the
+// last of which gets rendered (if there's an observation).
+//
+// The single-threaded rate with observations is the per-core rate, which is
+// what gets checked against the throughput target (--target env frames/s on a
+// --cores core box). Batches also pay for threading / memory bandwidth, so
+// compare the batch's per-thread rate against it on a real many-core box.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <clara.hpp>
+
+#include "../anese_env.h"
+
+using Clock = std::chrono::steady_clock;
+
+// Plain old fread. The loaders in ANESE_fs live alongside the full core, and
+// this links against libanese_env, which has its own (callback-less) build of
+// the core.
+static bool read_file(const char* path, std::vector<uint8_t>& data) {
+  FILE* f = fopen(path, "rb");
+  if (!f) return false;
+  fseek(f, 0, SEEK_END);
+  data.resize(ftell(f));
+  fseek(f, 0, SEEK_SET);
+  const bool ok = fread(data.data(), 1, data.size(), f) == data.size();
+  fclose(f);
+  return ok && !data.empty();
+}
+
+struct Config {
+  const char* name;
+  unsigned envs;
+  unsigned threads;
+  bool obs;
+};
+
+struct Result {
+  double frames_per_sec; // env frames / sec, across the whole batch
+  unsigned threads;
+};
+
+static bool run_config(const std::vector<uint8_t>& rom, const Config& cfg,
+                       unsigned skip, double seconds, Result& res) {
+  anese_env* env = anese_env_create(rom.data(), rom.size(),
+                                    cfg.envs, cfg.threads);
+  if (!env) return false;
+
+  std::vector<uint8_t> actions (cfg.envs);
+  std::vector<uint8_t> obs (cfg.obs ? cfg.envs * anese_env_obs_size(env) : 0);
+  uint8_t* obs_buf = cfg.obs ? obs.data() : nullptr;
+
+  // Every instance mashes its own random-ish buttons (with the odd Start
+  // press, to actually get into the game)
+  uint32_t seed = 0x2A03;
+  auto step = [&]() {
+    for (uint8_t& action : actions) {
+      seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5;
+      action = seed & ~ANESE_ENV_BTN_SELECT;
+      if ((seed >> 8) % 8) action &= ~ANESE_ENV_BTN_START;
+    }
+    anese_env_step(env, actions.data(), skip, obs_buf);
+  };
+
+  for (unsigned i = 0; i < 60 / skip + 1; i++) step(); // warm up (~1s of game)
+
+  uint64_t steps = 0;
+  const Clock::time_point start = Clock::now();
+  double elapsed;
+  do {
+    step();
+    steps++;
+    elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  } while (elapsed < seconds);
+
+  res.frames_per_sec = double(steps) * skip * cfg.envs / elapsed;
+  res.threads = cfg.threads
+    ? cfg.threads
+    : std::max(1u, std::min(cfg.envs, std::thread::hardware_concurrency()));
+
+  anese_env_destroy(env);
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  std::string rom_path;
+  unsigned envs = 256;
+  unsigned threads = 0;
+  unsigned skip = 4;
+  double seconds = 3.0;
+  unsigned cores = 32;
+  double target = 100000;
+
+  bool show_help = false;
+  auto cli
+    = clara::Help(show_help)
+    | clara::Opt(envs, "n")
+        ["--envs"]
+        ("instances in the batch (default: 256)")
+    | clara::Opt(threads, "n")
+        ["--threads"]
+        ("threads for the batch (default: 0, one per hardware thread)")
+    | clara::Opt(skip, "frames")
+        ["--skip"]
+        ("frames per step, only the last one is rendered (default: 4)")
+    | clara::Opt(seconds, "s")
+        ["--seconds"]
+        ("how long to time each configuration for (default: 3)")
+    | clara::Opt(cores, "n")
+        ["--cores"]
+        ("core count of the target box (default: 32)")
+    | clara::Opt(target, "frames/s")
+        ["--target"]
+        ("target env frames/s on that box (default: 100000)")
+    | clara::Arg(rom_path, "rom")
+        ("an iNES rom");
+
+  auto result = cli.parse(clara::Args(argc, argv));
+  if (!result || rom_path.empty() || show_help
+      || envs == 0 || skip == 0 || seconds <= 0 || cores == 0) {
+    if (!result) fprintf(stderr, "Error: %s\n", result.errorMessage().c_str());
+    std::cerr << cli;
+    return 1;
+  }
+
+  std::vector<uint8_t> rom;
+  if (!read_file(rom_path.c_str(), rom)) {
+    fprintf(stderr, "[EnvBench] Could not read '%s'\n", rom_path.c_str());
+    return 1;
+  }
+
+  const Config configs [] = {
+    { "per core, no obs", 1,    1,       false },
+    { "per core",         1,    1,       true  },
+    { "batch",            envs, threads, true  },
+  };
+
+  Result per_core {};
+  for (const Config& cfg : configs) {
+    Result res;
+    if (!run_config(rom, cfg, skip, seconds, res)) {
+      fprintf(stderr, "[EnvBench] Could not create env\n");
+      return 1;
+    }
+    printf("%-16s %4u envs, %3u threads: %10.0f env frames/s (%.0f per thread)\n",
+      cfg.name, cfg.envs, res.threads, res.frames_per_sec,
+      res.frames_per_sec / res.threads);
+    fflush(stdout);
+    if (&cfg == &configs[1]) per_core = res;
+  }
+
+  // Best case: every core runs as fast as a lone instance on a single thread
+  const double estimate = per_core.frames_per_sec * cores;
+  printf("%u core estimate (per-core rate x %u): %.0f env frames/s, "
+         "target %.0f: %s (needs %.0f per core)\n",
+    cores, cores, estimate, target,
+    estimate >= target ? "met" : "NOT met", target / cores);
+
+  return 0;
+}
@@ -0,0 +1,129 @@
+#include "obs.h"
+
+#include <cstring>
+
+#include "nes/ppu/ppu.h"
+
+// Dimensions of the frame coming out of the PPU
+static constexpr uint FRAME_W = 256;
+static constexpr uint FRAME_H = 240;
+
+bool ObsKernel::is_valid(Format format, uint width, uint height, bool max_pool) {
+  switch (format) {
+  case PALETTE:
+  case PALETTE_HALF:
+    // taking the max of two palette indices is meaningless
+    return !max_pool;
+  case GRAY:
+  case RGB:
+    // only downscaling is supported
+    return in_range(width, 1u, FRAME_W) && in_range(height, 1u, FRAME_H);
+  }
+  return false;
+}
+
+ObsKernel::ObsKernel(Format format, uint width, uint height, bool max_pool) {
+  this->format = format;
+  this->max_pool = max_pool;
+
+  switch (format) {
+  case PALETTE:      width = FRAME_W;     height = FRAME_H;     break;
+  case PALETTE_HALF: width = FRAME_W / 2; height = FRAME_H / 2; break;
+  case GRAY:
+  case RGB:
+    break;
+  }
+
+  this->width = width;
+  this->height = height;
+  this->channels = (format == RGB) ? 3 : 1;
+
+  for (uint x = 0; x < width; x++) {
+    this->col[x].lo = (x + 0) * FRAME_W / width;
+    this->col[x].hi = (x + 1) * FRAME_W / width;
+  }
+  for (uint y = 0; y < height; y++) {
+    this->row[y].lo = (y + 0) * FRAME_H / height;
+    this->row[y].hi = (y + 1) * FRAME_H / height;
+  }
+
+  for (uint i = 0; i < 64; i++) {
+    const Color& color = PPU::palette[i];
+    const uint r = color.r;
+    const uint g = color.g;
+    const uint b = color.b;
+
+    if (format == RGB) {
+      this->lut[i][0] = r;
+      this->lut[i][1] = g;
+      this->lut[i][2] = b;
+    } else {
+      // ITU-R 601 luma, in 8.8 fixed point
+      this->lut[i][0] = (77 * r + 150 * g + 29 * b + 128) >> 8;
+      this->lut[i][1] = 0;
+      this->lut[i][2] = 0;
+    }
+  }
+}
+
+// Box-filter downscale. Every output pixel is the average of the source pixels
+// that fall in its span (taking the per-channel max of the two frames first,
+// if pooling).
+template <uint C, bool POOL>
+void ObsKernel::area(const u8* frame, const u8* prev, u8* out) const {
+  u32 acc [FRAME_W * C];
+
+  for (uint oy = 0; oy < this->height; oy++) {
+    memset(acc, 0, sizeof acc[0] * this->width * C);
+
+    for (uint y = this->row[oy].lo; y < this->row[oy].hi; y++) {
+      const u8* src  = frame + y * FRAME_W;
+      const u8* src2 = POOL ? prev + y * FRAME_W : nullptr;
+
+      for (uint ox = 0; ox < this->width; ox++) {
+        u32* px_acc = acc + ox * C;
+        for (uint x = this->col[ox].lo; x < this->col[ox].hi; x++) {
+          const u8* px = this->lut[src[x] % 64];
+          if (POOL) {
+            const u8* px2 = this->lut[src2[x] % 64];
+            for (uint c = 0; c < C; c++)
+              px_acc[c] += px[c] > px2[c] ? px[c] : px2[c];
+          } else {
+            for (uint c = 0; c < C; c++)
+              px_acc[c] += px[c];
+          }
+        }
+      }
+    }
+
+    const uint span_h = this->row[oy].hi - this->row[oy].lo;
+    for (uint ox = 0; ox < this->width; ox++) {
+      const uint area = span_h * (this->col[ox].hi - this->col[ox].lo);
+      for (uint c = 0; c < C; c++)
+        *out++ = (acc[ox * C + c] + area / 2) / area;
+    }
+  }
+}
+
+void ObsKernel::run(const u8* frame, const u8* prev, u8* out) const {
+  switch (this->format) {
+  case PALETTE:
+    memcpy(out, frame, FRAME_W * FRAME_H);
+    break;
+  case PALETTE_HALF:
+    for (uint y = 0; y < FRAME_H; y += 2) {
+      const u8* src = frame + y * FRAME_W;
+      for (uint x = 0; x < FRAME_W; x += 2)
+        *out++ = src[x];
+    }
+    break;
+  case GRAY:
+    if (this->max_pool) this->area<1, true >(frame, prev, out);
+    else                this->area<1, false>(frame, prev, out);
+    break;
+  case RGB:
+    if (this->max_pool) this->area<3, true >(frame, prev, out);
+    else                this->area<3, false>(frame, prev, out);
+    break;
+  }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "common/util.h"
+
+// Observation kernels
+// Turn a 256x240 frame of raw NES palette indices (straight out of the PPU)
+// into an observation, written directly into the batch's output buffer.
+//
+// Working off of palette indices (1 byte per pixel) instead of the RGBA
+// framebuffer (4 bytes per pixel) cuts the memory traffic per observation way
+// down, and the palette -> gray / RGB conversion is just a 64 entry table.
+class ObsKernel final {
+public:
+  enum Format {
+    PALETTE,      // 256x240x1, raw palette indices
+    PALETTE_HALF, // 128x120x1, raw palette indices (top-left of every 2x2)
+    GRAY,         // WxHx1, grayscale (area-averaged)
+    RGB,          // WxHx3, RGB (area-averaged)
+  };
+
+private:
+  Format format;
+  uint width, height, channels;
+  bool max_pool; // per-pixel max over the last 2 frames (before downscaling)
+
+  // output column / row -> span of source columns / rows [lo, hi)
+  struct Span { u16 lo, hi; };
+  Span col [256];
+  Span row [240];
+
+  u8 lut [64][3]; // palette index -> channel values
+
+  template <uint C, bool POOL>
+  void area(const u8* frame, const u8* prev, u8* out) const;
+
+public:
+  ObsKernel(Format format, uint width, uint height, bool max_pool);
+
+  // Sanity checks a format (eg: palette indices can't be max-pooled)
+  static bool is_valid(Format format, uint width, uint height, bool max_pool);
+
+  uint size() const { return this->width * this->height * this->channels; }
+  bool needs_prev() const { return this->max_pool; }
+
+  // `prev` is only read when needs_prev()
+  void run(const u8* frame, const u8* prev, u8* out) const;
+};
@@ -0,0 +1,81 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(uint num_threads) {
+  this->job.fn = nullptr;
+  this->job.userdata = nullptr;
+  this->job.len = 0;
+  this->job.next = 0;
+
+  // the calling thread pitches in as well
+  for (uint i = 1; i < num_threads; i++)
+    this->workers.emplace_back(&ThreadPool::worker_loop, this);
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock (this->mutex);
+    this->stopping = true;
+  }
+  this->cv_start.notify_all();
+
+  for (std::thread& worker : this->workers)
+    worker.join();
+}
+
+void ThreadPool::run_job() {
+  uint i;
+  while ((i = this->job.next++) < this->job.len)
+    this->job.fn(this->job.userdata, i);
+}
+
+void ThreadPool::worker_loop() {
+  uint last_generation = 0;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock (this->mutex);
+      this->cv_start.wait(lock, [&]{
+        return this->stopping || this->generation != last_generation;
+      });
+      if (this->stopping) return;
+      last_generation = this->generation;
+    }
+
+    this->run_job();
+
+    {
+      std::lock_guard<std::mutex> lock (this->mutex);
+      if (--this->busy == 0)
+        this->cv_done.notify_one();
+    }
+  }
+}
+
+void ThreadPool::parallel_for(
+  uint len,
+  void (*fn)(void* userdata, uint i),
+  void* userdata
+) {
+  if (this->workers.empty()) {
+    for (uint i = 0; i < len; i++)
+      fn(userdata, i);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock (this->mutex);
+    this->job.fn = fn;
+    this->job.userdata = userdata;
+    this->job.len = len;
+    this->job.next = 0;
+
+    this->busy = this->workers.size();
+    this->generation++;
+  }
+  this->cv_start.notify_all();
+
+  this->run_job();
+
+  std::unique_lock<std::mutex> lock (this->mutex);
+  this->cv_done.wait(lock, [&]{ return this->busy == 0; });
+}
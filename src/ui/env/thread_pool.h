@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "common/util.h"
+
+// Dead simple fork-join thread pool.
+// parallel_for hands out indices to the workers (and the calling thread) one at
+// a time, and blocks until every last one of them has been processed.
+class ThreadPool final {
+private:
+  std::vector<std::thread> workers;
+
+  std::mutex mutex;
+  std::condition_variable cv_start; // a new job is up for grabs
+  std::condition_variable cv_done;  // all workers are done with the job
+
+  uint generation = 0; // bumped for every job
+  uint busy = 0;       // # of workers still on the current job
+  bool stopping = false;
+
+  // The current job
+  struct {
+    void (*fn)(void* userdata, uint i);
+    void* userdata;
+    uint len;
+    std::atomic<uint> next;
+  } job;
+
+  void worker_loop();
+  void run_job();
+
+public:
+  ~ThreadPool();
+  ThreadPool(uint num_threads);
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  uint size() const { return this->workers.size() + 1; }
+
+  // Calls fn(userdata, i) for every i in [0, len)
+  void parallel_for(uint len, void (*fn)(void* userdata, uint i), void* userdata);
+};
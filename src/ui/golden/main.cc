@@ -0,0 +1,499 @@
+// Framebuffer / audio golden tests
+// Runs ROMs (optionally driven by .fm2 movies) headlessly, and records a hash
+// of every frame's NES-color framebuffer and audio samples. The same case is
+// run in several emulation modes, which must all produce identical output:
+//   - default:      plain step_frame()
+//   - compact:      compact mode, rendering into an external target (no audio)
+//   - savestate:    every --interval frames, the state is moved to a brand new
+//                   NES through a flat savestate (save_state / load_state)
+//   - serialize:    same, but through serialize / deserialize
+//   - clone:        same, but through NES::clone()
+//   - instrumented: with the CPU trace, CPU profiler and subsystem timers on
+//   - incremental:  every frame goes into a ring of incremental savestates,
+//                   which must match a full save_state byte-for-byte (and
+//                   every --interval frames, the NES is loaded back from one)
+// The APU's output filters aren't part of the state, so the audio can't match
+// bit-for-bit after a savestate / clone. Those modes only check the video.
+// The default mode is also checked against a stored golden (see --goldens).
+//
+// For each case, the first divergent frame (and whether it was the video or
+// the audio that diverged) is reported.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <clara.hpp>
+
+#include "nes/cartridge/cartridge.h"
+#include "nes/joy/controllers/standard.h"
+#include "nes/nes.h"
+#include "nes/params.h"
+#include "ui/SDL2/fs/load.h"
+#include "ui/SDL2/movies/fm2/replay.h"
+
+using Clock = std::chrono::steady_clock;
+
+namespace Mode {
+  enum Type {
+    DEFAULT,
+    COMPACT,
+    SAVESTATE,
+    SERIALIZE,
+    CLONE,
+    INSTRUMENTED,
+    INCREMENTAL,
+    COUNT
+  };
+
+  static const char* names [COUNT] = {
+    "default", "compact", "savestate", "serialize", "clone", "instrumented",
+    "incremental"
+  };
+}
+
+struct Run {
+  bool ran = false;
+  std::string error;
+  std::vector<u64> video; // per frame
+  std::vector<u64> audio; // per frame (empty if the mode doesn't check audio)
+};
+
+struct Case {
+  std::string rom;
+  std::string movie;
+  uint frames = 0;
+
+  Run runs [Mode::COUNT];
+
+  // file name of the golden
+  std::string name() const {
+    std::string name = this->rom;
+    if (!this->movie.empty()) name += "+" + this->movie;
+    for (char& c : name)
+      if (c == '/' || c == '\\' || c == ':') c = '_';
+    return name + ".golden";
+  }
+};
+
+struct Options {
+  uint interval = 60; // frames between savestates / clones
+};
+
+/*----------------------------  Running a case  ----------------------------*/
+
+// A fresh NES (with its own mapper), taking over the state of another
+static NES* transplant(NES* nes, Mode::Type mode, const NES_Params& params,
+                       const ROM_File* rom_file, Mapper*& mapper,
+                       std::vector<u8>& state) {
+  NES* next;
+  Mapper* next_mapper = nullptr;
+
+  if (mode == Mode::CLONE) {
+    next = nes->clone(); // owns its own copy of the mapper
+  } else {
+    next_mapper = Mapper::Factory(rom_file);
+    next = new NES (params);
+    next->loadCartridge(next_mapper);
+    next->power_cycle();
+
+    if (mode == Mode::SAVESTATE) {
+      state.resize(nes->state_size());
+      nes->save_state(state.data());
+      next->load_state(state.data());
+    } else {
+      Serializable::Chunk* chunk = nes->serialize();
+      next->deserialize(chunk);
+      delete chunk;
+    }
+  }
+
+  delete nes;
+  delete mapper;
+  mapper = next_mapper;
+  return next;
+}
+
+static void run_case(Case& c, Mode::Type mode, const Options& opts) {
+  Run& run = c.runs[mode];
+  run.ran = true;
+
+  NES_Params params {};
+  params.apu_sample_rate = 44100;
+  params.speed = 100;
+  params.compact = mode == Mode::COMPACT;
+  if (mode == Mode::INSTRUMENTED) {
+    params.log_cpu = true;
+    params.profile = true;
+    params.profile_cpu = true;
+  }
+
+  Cartridge cart (ANESE_fs::load::load_rom_file(c.rom.c_str()));
+  if (cart.status() != Cartridge::Status::CART_NO_ERROR) {
+    run.error = "could not load ROM";
+    return;
+  }
+
+  FM2_Replay replay;
+  JOY_Standard joy [2] { { "P1" }, { "P2" } };
+  if (!c.movie.empty() && !replay.init(c.movie.c_str())) {
+    run.error = "could not load movie";
+    return;
+  }
+
+  Memory* joys [2];
+  for (uint i = 0; i < 2; i++)
+    joys[i] = c.movie.empty() ? &joy[i] : replay.get_joy(i);
+
+  NES* nes = new NES (params);
+  nes->loadCartridge(cart.get_mapper());
+  nes->power_cycle();
+
+  Mapper* mapper = nullptr; // owned by the run (not the cartridge)
+  std::vector<u8> state;
+  // The NES steps a whole CPU instruction at a time, so the first few dots of
+  // a frame are rendered by the time step_frame() returns. Framebuffers aren't
+  // part of the state though, so modes that switch NESs mid-run render into a
+  // target of their own (which carries over).
+  const bool transplants = mode == Mode::SAVESTATE
+                        || mode == Mode::SERIALIZE
+                        || mode == Mode::CLONE;
+  static thread_local u8 framebuffer [256 * 240];
+
+  // incremental mode: a ring of savestates (each with its own sync token), and
+  // a full savestate to check them against
+  const bool incremental = mode == Mode::INCREMENTAL;
+  constexpr uint RING = 4;
+  std::vector<u8> ring [RING];
+  u32 ring_sync [RING] = {0};
+  std::vector<u8> full;
+
+  for (uint frame = 0; frame < c.frames; frame++) {
+    if (transplants && frame && frame % opts.interval == 0)
+      nes = transplant(nes, mode, params, cart.get_rom_file(), mapper, state);
+
+    // external framebuffers / joypads aren't part of the state
+    for (uint i = 0; i < 2; i++) nes->attach_joy(i, joys[i]);
+    if (params.compact || transplants)
+      nes->_ppu().setFramebuffNESColorTarget(framebuffer);
+
+    if (!c.movie.empty()) {
+      replay.step_frame();
+      if (!replay.is_enabled()) break; // end of the movie
+    }
+
+    nes->step_frame();
+
+    if (incremental) {
+      const uint slot = frame % RING;
+      ring[slot].resize(nes->state_size());
+      full.resize(nes->state_size());
+      nes->save_state_incremental(ring[slot].data(), ring_sync[slot]);
+      nes->save_state(full.data());
+      if (memcmp(ring[slot].data(), full.data(), full.size()) != 0) {
+        run.error = "incremental savestate differs from a full one at frame "
+                  + std::to_string(frame);
+        break;
+      }
+      if (frame && frame % opts.interval == 0)
+        nes->load_state(ring[slot].data());
+    }
+
+    const u8* fb;
+    nes->_ppu().getFramebuffNESColor(&fb);
+    run.video.push_back(fnv1a(fb, 256 * 240));
+
+    float* samples; uint len;
+    nes->getAudiobuff(&samples, &len);
+    if (!params.compact && !transplants)
+      run.audio.push_back(fnv1a(samples, len * sizeof samples[0]));
+  }
+
+  delete nes;
+  delete mapper;
+}
+
+/*-------------------------------  Goldens  --------------------------------*/
+
+// Golden files are plain text:
+//   anese_golden 1 <frames>
+//   <video hash> <audio hash>   (one line per frame, in hex)
+static bool write_golden(const char* path, const Run& run) {
+  FILE* f = fopen(path, "w");
+  if (!f) return false;
+  fprintf(f, "anese_golden 1 %u\n", uint(run.video.size()));
+  for (size_t i = 0; i < run.video.size(); i++)
+    fprintf(f, "%016" PRIx64 " %016" PRIx64 "\n", run.video[i], run.audio[i]);
+  fclose(f);
+  return true;
+}
+
+static bool read_golden(const char* path, Run& run) {
+  FILE* f = fopen(path, "r");
+  if (!f) return false;
+
+  uint version, frames;
+  if (fscanf(f, "anese_golden %u %u", &version, &frames) != 2 || version != 1) {
+    fclose(f);
+    return false;
+  }
+
+  run.ran = true;
+  for (uint i = 0; i < frames; i++) {
+    u64 video, audio;
+    if (fscanf(f, "%" SCNx64 " %" SCNx64, &video, &audio) != 2) break;
+    run.video.push_back(video);
+    run.audio.push_back(audio);
+  }
+
+  fclose(f);
+  return run.video.size() == frames;
+}
+
+// Finds the first frame at which two runs diverge.
+// Returns false if they're identical.
+static bool diverges(const Run& a, const Run& b, uint& frame, const char*& what) {
+  const size_t len = std::min(a.video.size(), b.video.size());
+  const bool audio = !a.audio.empty() && !b.audio.empty();
+  for (frame = 0; frame < len; frame++) {
+    const bool video_diff = a.video[frame] != b.video[frame];
+    const bool audio_diff = audio && a.audio[frame] != b.audio[frame];
+    if (video_diff || audio_diff) {
+      what = video_diff && audio_diff ? "video + audio" : video_diff ? "video" : "audio";
+      return true;
+    }
+  }
+  if (a.video.size() != b.video.size()) {
+    what = "length";
+    return true;
+  }
+  return false;
+}
+
+/*---------------------------------  Setup  --------------------------------*/
+
+static std::string movie_for(const std::string& rom) {
+  const size_t dot = rom.find_last_of('.');
+  const std::string movie = rom.substr(0, dot) + ".fm2";
+  FILE* f = fopen(movie.c_str(), "r");
+  if (!f) return "";
+  fclose(f);
+  return movie;
+}
+
+// Manifest: one `<frames> <rom> [<fm2 movie>]` per line (lines starting with
+// '#' are comments)
+static bool load_manifest(const char* path, std::vector<Case>& cases) {
+  FILE* f = fopen(path, "r");
+  if (!f) return false;
+
+  char line [2048];
+  while (fgets(line, sizeof line, f)) {
+    uint frames;
+    char rom [1000], movie [1000] = "";
+    if (line[0] == '#' || sscanf(line, "%u %999s %999s", &frames, rom, movie) < 2)
+      continue;
+
+    Case c;
+    c.rom = rom;
+    c.movie = movie;
+    c.frames = frames;
+    cases.push_back(c);
+  }
+
+  fclose(f);
+  return true;
+}
+
+static bool parse_modes(const std::string& list, bool (&enabled)[Mode::COUNT]) {
+  for (bool& e : enabled) e = false;
+  enabled[Mode::DEFAULT] = true; // always the reference
+
+  size_t start = 0;
+  while (start <= list.size()) {
+    size_t end = list.find(',', start);
+    if (end == std::string::npos) end = list.size();
+    const std::string name = list.substr(start, end - start);
+    start = end + 1;
+    if (name.empty()) continue;
+
+    uint i = 0;
+    while (i < Mode::COUNT && name != Mode::names[i]) i++;
+    if (i == Mode::COUNT) {
+      fprintf(stderr, "[Golden] Unknown mode '%s'\n", name.c_str());
+      return false;
+    }
+    enabled[i] = true;
+  }
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  std::vector<std::string> roms;
+  std::string manifest_path;
+  std::string goldens_dir;
+  std::string modes_list = "compact,savestate,serialize,clone,instrumented,incremental";
+  uint frames = 600;
+  uint jobs = std::thread::hardware_concurrency();
+  bool update = false;
+  Options opts;
+
+  bool show_help = false;
+  auto cli
+    = clara::Help(show_help)
+    | clara::Opt(jobs, "n")
+        ["-j"]["--jobs"]
+        ("# of runs at once (default: # of cores)")
+    | clara::Opt(manifest_path, "path")
+        ["--manifest"]
+        ("cases to run (lines of `<frames> <rom> [<fm2 movie>]`)")
+    | clara::Opt(frames, "n")
+        ["--frames"]
+        ("frames to run ROMs given on the command line for \n"
+         "(default: 600). A .fm2 next to the ROM is replayed.")
+    | clara::Opt(modes_list, "a,b,...")
+        ["--modes"]
+        ("modes to check against the default one (default: \n"
+         "compact,savestate,serialize,clone,instrumented,\n"
+         "incremental)")
+    | clara::Opt(opts.interval, "frames")
+        ["--interval"]
+        ("frames between savestates / clones (default: 60)")
+    | clara::Opt(goldens_dir, "dir")
+        ["--goldens"]
+        ("directory of golden hashes to check against")
+    | clara::Opt(update)
+        ["--update"]
+        ("(re)write the goldens, instead of checking them")
+    | clara::Arg(roms, "rom")
+        ("ROMs to run");
+
+  auto result = cli.parse(clara::Args(argc, argv));
+  bool modes [Mode::COUNT];
+  if (!result || show_help || opts.interval == 0
+      || !parse_modes(modes_list, modes)
+      || (update && goldens_dir.empty())) {
+    if (!result) fprintf(stderr, "Error: %s\n", result.errorMessage().c_str());
+    std::cerr << cli;
+    return 1;
+  }
+
+  std::vector<Case> cases;
+  if (!manifest_path.empty() && !load_manifest(manifest_path.c_str(), cases)) {
+    fprintf(stderr, "[Golden] Could not open '%s'\n", manifest_path.c_str());
+    return 1;
+  }
+  for (const std::string& rom : roms) {
+    Case c;
+    c.rom = rom;
+    c.movie = movie_for(rom);
+    c.frames = frames;
+    cases.push_back(c);
+  }
+  if (cases.empty()) {
+    fprintf(stderr, "[Golden] Nothing to run\n");
+    std::cerr << cli;
+    return 1;
+  }
+
+  /*----------  Run  ----------*/
+
+  // every (case, mode) pair is a separate job
+  struct Job { Case* c; Mode::Type mode; };
+  std::vector<Job> queue;
+  for (Case& c : cases)
+    for (uint m = 0; m < Mode::COUNT; m++)
+      if (modes[m] && (m == Mode::DEFAULT || !update))
+        queue.push_back({ &c, Mode::Type(m) });
+
+  if (jobs == 0) jobs = 1;
+  fprintf(stderr, "[Golden] Running %u cases (%u runs, %u at a time)\n",
+    uint(cases.size()), uint(queue.size()), jobs);
+
+  const auto start = Clock::now();
+
+  std::atomic<uint> next { 0 };
+  auto worker = [&]() {
+    for (uint i; (i = next++) < queue.size(); )
+      run_case(*queue[i].c, queue[i].mode, opts);
+  };
+
+  std::vector<std::thread> threads;
+  for (uint i = 0; i < jobs; i++)
+    threads.emplace_back(worker);
+  for (std::thread& thread : threads)
+    thread.join();
+
+  const double ms = std::chrono::duration<double, std::milli>(
+    Clock::now() - start
+  ).count();
+
+  /*----------  Compare  ----------*/
+
+  uint failed = 0;
+  for (Case& c : cases) {
+    const Run& ref = c.runs[Mode::DEFAULT];
+    const std::string label = c.movie.empty() ? c.rom : c.rom + " + " + c.movie;
+    const std::string golden_path = goldens_dir + "/" + c.name();
+    bool ok = true;
+
+    if (!ref.error.empty()) {
+      printf("ERROR %s: %s\n", label.c_str(), ref.error.c_str());
+      failed++;
+      continue;
+    }
+
+    if (update) {
+      if (!write_golden(golden_path.c_str(), ref)) {
+        printf("ERROR %s: could not write '%s'\n", label.c_str(), golden_path.c_str());
+        failed++;
+      } else {
+        printf("wrote %s (%u frames)\n", golden_path.c_str(), uint(ref.video.size()));
+      }
+      continue;
+    }
+
+    uint frame;
+    const char* what;
+    for (uint m = 1; m < Mode::COUNT; m++) {
+      const Run& run = c.runs[m];
+      if (!run.ran) continue;
+      if (!run.error.empty()) {
+        printf("FAIL  %s: %s mode: %s\n", label.c_str(), Mode::names[m],
+          run.error.c_str());
+        ok = false;
+      } else if (diverges(ref, run, frame, what)) {
+        printf("FAIL  %s: %s mode diverges at frame %u (%s)\n",
+          label.c_str(), Mode::names[m], frame, what);
+        ok = false;
+      }
+    }
+
+    if (!goldens_dir.empty()) {
+      Run golden;
+      if (!read_golden(golden_path.c_str(), golden)) {
+        printf("FAIL  %s: no golden at '%s'\n", label.c_str(), golden_path.c_str());
+        ok = false;
+      } else if (diverges(golden, ref, frame, what)) {
+        printf("FAIL  %s: diverges from the golden at frame %u (%s)\n",
+          label.c_str(), frame, what);
+        ok = false;
+      }
+    }
+
+    if (ok) printf("ok    %s (%u frames)\n", label.c_str(), uint(ref.video.size()));
+    else failed++;
+  }
+
+  printf("%u / %u cases ok, in %.1fs\n",
+    uint(cases.size()) - failed, uint(cases.size()), ms / 1000);
+
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,349 @@
+// Lockstep determinism checker
+// Runs two NESs with different configurations (eg: the reference interpreter
+// vs. the fast paths) side by side, on separate threads, with the same input.
+// After every frame, a hash of each NES's state is compared. On the first
+// mismatch, both states (and the last state they agreed on) are dumped as
+// savestates, along with a window of the CPU trace of any side that has one.
+//
+// Configurations are comma-separated lists of (or "none" for the defaults):
+//   - trace:           record a CPU trace (this also turns off the CPU's idle
+//                      loop skipping, making it the reference interpreter)
+//   - frameskip:       run every frame in the PPU's frameskip mode
+//   - compact:         compact mode (nothing to render into, so no rendering)
+//   - profile:         time each subsystem
+//   - profile_cpu:     run the CPU profiler
+//   - ppu_timing_hack: turn on the PPU timing hack
+
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <clara.hpp>
+
+#include "nes/cartridge/cartridge.h"
+#include "nes/cpu/trace.h"
+#include "nes/joy/controllers/standard.h"
+#include "nes/nes.h"
+#include "nes/params.h"
+#include "ui/SDL2/fs/load.h"
+#include "ui/SDL2/movies/fm2/replay.h"
+
+/*---------------------------------  Sides  --------------------------------*/
+
+struct Side {
+  const char* name;
+  std::string config;
+
+  NES_Params params {};
+  bool frameskip = false;
+
+  Cartridge* cart = nullptr;
+  NES* nes = nullptr;
+
+  FM2_Replay replay;
+  bool has_movie = false;
+  JOY_Standard joy [2] { { "P1" }, { "P2" } };
+
+  // end-of-frame state
+  std::vector<u8> state;
+  u64 hash = 0;
+  bool movie_ended = false;
+
+  ~Side() {
+    delete this->nes;
+    delete this->cart;
+  }
+
+  bool parse_config() {
+    this->params.apu_sample_rate = 44100;
+    this->params.speed = 100;
+
+    size_t start = 0;
+    while (start <= this->config.size()) {
+      size_t end = this->config.find(',', start);
+      if (end == std::string::npos) end = this->config.size();
+      const std::string flag = this->config.substr(start, end - start);
+      start = end + 1;
+
+      /**/ if (flag.empty() || flag == "none") continue;
+      else if (flag == "trace")           this->params.log_cpu = true;
+      else if (flag == "frameskip")       this->frameskip = true;
+      else if (flag == "compact")         this->params.compact = true;
+      else if (flag == "profile")         this->params.profile = true;
+      else if (flag == "profile_cpu")     this->params.profile_cpu = true;
+      else if (flag == "ppu_timing_hack") this->params.ppu_timing_hack = true;
+      else {
+        fprintf(stderr, "[Lockstep] Unknown option '%s'\n", flag.c_str());
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool init(const std::string& rom, const std::string& movie) {
+    this->cart = new Cartridge (ANESE_fs::load::load_rom_file(rom.c_str()));
+    if (this->cart->status() != Cartridge::Status::CART_NO_ERROR) {
+      fprintf(stderr, "[Lockstep] Could not load '%s'\n", rom.c_str());
+      return false;
+    }
+
+    this->has_movie = !movie.empty();
+    if (this->has_movie && !this->replay.init(movie.c_str())) {
+      fprintf(stderr, "[Lockstep] Could not load '%s'\n", movie.c_str());
+      return false;
+    }
+
+    this->nes = new NES (this->params);
+    for (uint i = 0; i < 2; i++)
+      this->nes->attach_joy(i, this->has_movie
+        ? this->replay.get_joy(i)
+        : &this->joy[i]);
+    this->nes->loadCartridge(this->cart->get_mapper());
+    this->nes->power_cycle();
+
+    this->state.resize(this->nes->state_size());
+    return true;
+  }
+
+  void step_frame(u8 buttons) {
+    if (this->has_movie) {
+      this->replay.step_frame();
+      this->movie_ended = !this->replay.is_enabled();
+      if (this->movie_ended) return;
+    } else {
+      for (uint i = 0; i < 8; i++) {
+        const auto btn = JOY_Standard_Button::Type(1 << i);
+        this->joy[0].set_button(btn, buttons & btn);
+      }
+    }
+
+    if (this->frameskip) this->nes->skip_frame();
+    else                 this->nes->step_frame();
+
+    this->nes->save_state(this->state.data());
+    this->hash = fnv1a(this->state.data(), this->state.size());
+  }
+};
+
+/*--------------------------------  Dumping  -------------------------------*/
+
+// Writes a savestate in the same format as the frontend's `<rom>.state` files
+// (as the first of its 4 slots)
+static bool write_savestate(const std::string& path, const NES& nes) {
+  FILE* f = fopen(path.c_str(), "wb");
+  if (!f) return false;
+
+  Serializable::Chunk* chunk = nes.serialize();
+  const u8* data; uint len;
+  Serializable::Chunk::collate(data, len, chunk);
+  delete chunk;
+
+  const uint empty = 0;
+  fwrite(&len, sizeof len, 1, f);
+  if (data) fwrite(data, 1, len, f);
+  for (uint i = 1; i < 4; i++) fwrite(&empty, sizeof empty, 1, f);
+
+  delete[] data;
+  fclose(f);
+  return true;
+}
+
+// Writes the last `window` traced instructions, in the nestest log format
+static bool write_trace(const std::string& path, const CPU_TraceRing& ring,
+                        uint window) {
+  FILE* f = fopen(path.c_str(), "w");
+  if (!f) return false;
+
+  const u64 written = ring.written();
+  u64 oldest = written > window ? written - window : 0;
+  if (written - oldest >= ring.size()) oldest = written - ring.size() + 1;
+
+  char line [CPU_TraceEntry::NESTEST_LEN];
+  for (u64 i = oldest; i < written; i++) {
+    ring[i].to_nestest(line);
+    fprintf(f, "%s SL:%3u DOT:%3u\n", line, ring[i].scanline, ring[i].dot);
+  }
+
+  fclose(f);
+  return true;
+}
+
+static void dump_mismatch(Side (&sides)[2], const std::vector<u8>& last_good,
+                          const std::string& out, uint window) {
+  // where do the states differ?
+  uint first = 0, count = 0;
+  for (size_t i = 0; i < sides[0].state.size(); i++) {
+    if (sides[0].state[i] == sides[1].state[i]) continue;
+    if (!count++) first = i;
+  }
+  printf("%u bytes of state differ (first at offset 0x%X of %u)\n",
+    count, first, uint(sides[0].state.size()));
+
+  for (Side& side : sides) {
+    const std::string path = out + "/" + side.name + ".state";
+    if (write_savestate(path, *side.nes)) printf("wrote %s\n", path.c_str());
+
+    if (side.params.log_cpu) {
+      const std::string path = out + "/" + side.name + ".trace.txt";
+      if (write_trace(path, side.nes->_cpu()._trace(), window))
+        printf("wrote %s\n", path.c_str());
+    }
+  }
+
+  // the last state both sides agreed on (i.e: the start of the bad frame)
+  if (!last_good.empty()) {
+    sides[0].nes->load_state(last_good.data());
+    const std::string path = out + "/good.state";
+    if (write_savestate(path, *sides[0].nes)) printf("wrote %s\n", path.c_str());
+  }
+}
+
+/*---------------------------------  Main  ---------------------------------*/
+
+int main(int argc, char* argv[]) {
+  std::string rom;
+  std::string movie;
+  std::string out = ".";
+  uint frames = 3600;
+  uint window = 1000;
+  u32 seed = 1;
+
+  Side sides [2];
+  sides[0].name = "a";
+  sides[0].config = "trace";
+  sides[1].name = "b";
+  sides[1].config = "none";
+
+  bool show_help = false;
+  auto cli
+    = clara::Help(show_help)
+    | clara::Opt(sides[0].config, "options")
+        ["-a"]
+        ("configuration of the first NES (default: trace)")
+    | clara::Opt(sides[1].config, "options")
+        ["-b"]
+        ("configuration of the second NES (default: none)")
+    | clara::Opt(frames, "n")
+        ["--frames"]
+        ("# of frames to run (default: 3600)")
+    | clara::Opt(movie, "path")
+        ["--movie"]
+        ("input from an .fm2 movie (default: random input)")
+    | clara::Opt(seed, "n")
+        ["--seed"]
+        ("seed for the random input (default: 1)")
+    | clara::Opt(out, "dir")
+        ["--out"]
+        ("where to dump the states / traces on a mismatch (default: .)")
+    | clara::Opt(window, "n")
+        ["--window"]
+        ("# of instructions of CPU trace to dump (default: 1000)")
+    | clara::Arg(rom, "rom")
+        ("the ROM to run");
+
+  auto result = cli.parse(clara::Args(argc, argv));
+  if (!result || show_help || rom.empty()
+      || !sides[0].parse_config() || !sides[1].parse_config()) {
+    if (!result) fprintf(stderr, "Error: %s\n", result.errorMessage().c_str());
+    std::cerr << cli;
+    return 1;
+  }
+
+  for (Side& side : sides)
+    if (!side.init(rom, movie)) return 1;
+
+  if (sides[0].state.size() != sides[1].state.size()) {
+    fprintf(stderr, "[Lockstep] The NESs' states aren't the same size!\n");
+    return 1;
+  }
+
+  /*----------  Run  ----------*/
+
+  // Each side runs on its own thread. The main thread hands out one frame at
+  // a time (along with its input), and compares the results once both sides
+  // are done with it.
+  std::mutex mutex;
+  std::condition_variable cv;
+  uint go = 0;   // frames handed out
+  uint done = 0; // sides done with the current frame
+  bool stop = false;
+  u8 buttons = 0;
+
+  auto worker = [&](Side& side) {
+    for (uint frame = 0; ; frame++) {
+      u8 input;
+      {
+        std::unique_lock<std::mutex> lock (mutex);
+        cv.wait(lock, [&]() { return stop || go > frame; });
+        if (stop) return;
+        input = buttons;
+      }
+
+      side.step_frame(input);
+
+      {
+        std::lock_guard<std::mutex> lock (mutex);
+        done++;
+      }
+      cv.notify_all();
+    }
+  };
+
+  std::thread threads [2] {
+    std::thread (worker, std::ref(sides[0])),
+    std::thread (worker, std::ref(sides[1]))
+  };
+
+  std::vector<u8> last_good;
+  int mismatch = -1;
+  uint frame = 0;
+  for (; frame < frames; frame++) {
+    {
+      std::unique_lock<std::mutex> lock (mutex);
+      // random presses, held for a few frames at a time
+      if (frame % 8 == 0) {
+        using namespace JOY_Standard_Button;
+        seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5;
+        buttons = seed & 0xFF;
+        // no pressing opposite directions at once
+        if (buttons & Up)   buttons &= ~Down;
+        if (buttons & Left) buttons &= ~Right;
+      }
+      done = 0;
+      go++;
+      cv.notify_all();
+      cv.wait(lock, [&]() { return done == 2; });
+    }
+
+    if (sides[0].movie_ended || sides[1].movie_ended) break;
+
+    if (sides[0].hash != sides[1].hash) {
+      mismatch = frame;
+      break;
+    }
+    last_good = sides[0].state;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock (mutex);
+    stop = true;
+  }
+  cv.notify_all();
+  for (std::thread& thread : threads) thread.join();
+
+  if (mismatch < 0) {
+    printf("ok: '%s' and '%s' agree for %u frames\n",
+      sides[0].config.c_str(), sides[1].config.c_str(), frame);
+    return 0;
+  }
+
+  printf("MISMATCH at frame %d ('%s' vs '%s')\n",
+    mismatch, sides[0].config.c_str(), sides[1].config.c_str());
+  dump_mismatch(sides, last_good, out, window);
+  return 1;
+}
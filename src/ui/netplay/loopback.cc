@@ -0,0 +1,60 @@
+#include "loopback.h"
+
+#include <cassert>
+#include <cstring>
+
+LoopbackLink::LoopbackLink(const Params& params, u32 seed) {
+  this->params = params;
+  this->rng = seed ? seed : 1;
+
+  for (uint side = 0; side < 2; side++) {
+    this->ends[side].link = this;
+    this->ends[side].side = side;
+  }
+}
+
+// xorshift32
+u32 LoopbackLink::rand() {
+  this->rng ^= this->rng << 13;
+  this->rng ^= this->rng >> 17;
+  this->rng ^= this->rng << 5;
+  return this->rng;
+}
+
+void LoopbackTransport::send(const u8* data, uint len) {
+  assert(len <= NetplayTransport::MAX_PACKET);
+  LoopbackLink& link = *this->link;
+
+  link.stats.sent++;
+  if (link.rand() % 100 < link.params.loss) {
+    link.stats.dropped++;
+    return;
+  }
+
+  LoopbackLink::Packet packet;
+  packet.arrives = link.now + link.params.latency;
+  if (link.params.jitter)
+    packet.arrives += link.rand() % (link.params.jitter + 1);
+  packet.len = len;
+  memcpy(packet.data, data, len);
+
+  link.in_flight[!this->side].push_back(packet);
+}
+
+uint LoopbackTransport::recv(u8* data) {
+  LoopbackLink& link = *this->link;
+  std::vector<LoopbackLink::Packet>& in_flight = link.in_flight[this->side];
+
+  // hand out packets in order of arrival (which isn't necessarily the order
+  // they were sent in)
+  for (uint i = 0; i < in_flight.size(); i++) {
+    if (in_flight[i].arrives > link.now) continue;
+
+    const uint len = in_flight[i].len;
+    memcpy(data, in_flight[i].data, len);
+    in_flight.erase(in_flight.begin() + i);
+    return len;
+  }
+
+  return 0;
+}
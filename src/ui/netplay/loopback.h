@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+
+#include "common/util.h"
+#include "transport.h"
+
+class LoopbackLink;
+
+// One end of a LoopbackLink
+class LoopbackTransport final : public NetplayTransport {
+private:
+  friend class LoopbackLink;
+  LoopbackLink* link = nullptr;
+  uint side = 0;
+
+public:
+  void send(const u8* data, uint len) override;
+  uint recv(u8* data) override;
+};
+
+// In-process stand-in for a network connection between two peers, with
+// synthetic latency, jitter, and packet loss.
+// Time is measured in ticks (the host calls tick() once per host frame), which
+// keeps runs fully deterministic for a given seed.
+class LoopbackLink final {
+public:
+  struct Params {
+    uint latency = 0; // ticks before a packet arrives
+    uint jitter  = 0; // up to this many extra ticks (packets get reordered)
+    uint loss    = 0; // % of packets that get dropped
+  };
+
+private:
+  friend class LoopbackTransport;
+
+  Params params;
+  u32 rng;
+  uint now = 0;
+
+  struct Packet {
+    uint arrives;
+    uint len;
+    u8 data [NetplayTransport::MAX_PACKET];
+  };
+  std::vector<Packet> in_flight [2]; // packets headed to side 0 / side 1
+
+  LoopbackTransport ends [2];
+
+  u32 rand();
+
+public:
+  LoopbackLink(const Params& params, u32 seed = 1);
+
+  LoopbackLink(const LoopbackLink&) = delete;
+  LoopbackLink& operator=(const LoopbackLink&) = delete;
+
+  NetplayTransport& end(uint side) { return this->ends[side]; }
+
+  void tick() { this->now++; }
+
+  struct {
+    uint sent = 0;
+    uint dropped = 0;
+  } stats;
+};
@@ -0,0 +1,217 @@
+#include "rollback.h"
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+/*----------  Packets  ----------*/
+
+// u32 ack   - # of the peer's inputs that have been received (in order)
+// u32 start - frame # of the first input
+// u8  count - # of inputs
+// u8  input [count]
+static constexpr uint PACKET_HEADER = 9;
+static constexpr uint PACKET_MAX_INPUTS = 64;
+static_assert(PACKET_HEADER + PACKET_MAX_INPUTS <= NetplayTransport::MAX_PACKET,
+  "netplay packets don't fit in the transport");
+
+static void write_u32(u8* p, u32 val) {
+  p[0] = val >> 0;
+  p[1] = val >> 8;
+  p[2] = val >> 16;
+  p[3] = val >> 24;
+}
+
+static u32 read_u32(const u8* p) {
+  return u32(p[0]) << 0
+       | u32(p[1]) << 8
+       | u32(p[2]) << 16
+       | u32(p[3]) << 24;
+}
+
+/*----------  Session  ----------*/
+
+RollbackSession::~RollbackSession() {
+  delete this->joy_layout[0];
+  delete this->joy_layout[1];
+}
+
+RollbackSession::RollbackSession(
+  NES& nes,
+  JOY_Standard& joy_1, JOY_Standard& joy_2,
+  uint local_player,
+  NetplayTransport& transport,
+  uint max_rollback
+)
+: nes(nes)
+, transport(transport)
+{
+  assert(local_player < 2);
+  assert(max_rollback > 0 && max_rollback <= INPUT_HISTORY);
+
+  this->joy[0] = &joy_1;
+  this->joy[1] = &joy_2;
+  this->local = local_player;
+  this->remote = !local_player;
+  this->max_rollback = max_rollback;
+
+  this->joy_layout[0] = new Serializable::Layout (joy_1);
+  this->joy_layout[1] = new Serializable::Layout (joy_2);
+
+  this->nes_state_size = nes.state_size();
+  this->state_size = this->nes_state_size
+                   + this->joy_layout[0]->state_size()
+                   + this->joy_layout[1]->state_size();
+  this->states.resize(max_rollback);
+  for (std::vector<u8>& state : this->states)
+    state.resize(this->state_size);
+  this->state_sync.resize(max_rollback, 0);
+
+  memset(this->local_input,   0, sizeof this->local_input);
+  memset(this->remote_input,  0, sizeof this->remote_input);
+  memset(this->remote_played, 0, sizeof this->remote_played);
+}
+
+void RollbackSession::save_state(uint frame) {
+  const uint slot = frame % this->max_rollback;
+  u8* state = this->states[slot].data();
+  this->nes.save_state_incremental(state, this->state_sync[slot]);
+  state += this->nes_state_size;
+  this->joy_layout[0]->save(state);
+  state += this->joy_layout[0]->state_size();
+  this->joy_layout[1]->save(state);
+}
+
+void RollbackSession::load_state(uint frame) {
+  const uint slot = frame % this->max_rollback;
+  const u8* state = this->states[slot].data();
+  this->state_sync[slot] = this->nes.load_state(state);
+  state += this->nes_state_size;
+  this->joy_layout[0]->load(state);
+  state += this->joy_layout[0]->state_size();
+  this->joy_layout[1]->load(state);
+}
+
+void RollbackSession::run_frame(uint frame, bool render) {
+  this->save_state(frame);
+
+  // predict that the remote player is still holding down whatever they were
+  // holding down last
+  u8 remote_input = 0x00;
+  if (frame < this->remote_frame)
+    remote_input = this->remote_input[frame % INPUT_HISTORY];
+  else if (this->remote_frame > 0)
+    remote_input = this->remote_input[(this->remote_frame - 1) % INPUT_HISTORY];
+  this->remote_played[frame % INPUT_HISTORY] = remote_input;
+
+  const u8 local_input = this->local_input[frame % INPUT_HISTORY];
+  for (uint b = 0; b < 8; b++) {
+    const auto btn = JOY_Standard_Button::Type(1 << b);
+    this->joy[this->local ]->set_button(btn, nth_bit(local_input,  b));
+    this->joy[this->remote]->set_button(btn, nth_bit(remote_input, b));
+  }
+
+  if (render)
+    this->nes.step_frame();
+  else
+    this->nes.resim_frame();
+}
+
+void RollbackSession::rollback() {
+  const uint from = this->rollback_to;
+  this->rollback_to = NO_ROLLBACK;
+
+  // only frames still waiting on remote input can be mispredicted, and those
+  // are never more than max_rollback frames back
+  assert(from < this->frame && this->frame - from <= this->max_rollback);
+
+  this->load_state(from);
+  for (uint frame = from; frame < this->frame; frame++)
+    this->run_frame(frame, false);
+
+  const uint len = this->frame - from;
+  this->stats.rollbacks++;
+  this->stats.resimulated += len;
+  if (len > this->stats.max_rollback)
+    this->stats.max_rollback = len;
+}
+
+void RollbackSession::recv_packets() {
+  u8 packet [NetplayTransport::MAX_PACKET];
+  uint len;
+  while ((len = this->transport.recv(packet))) {
+    if (len < PACKET_HEADER || len != PACKET_HEADER + packet[8]) {
+      fprintf(stderr, "[Netplay] Dropping malformed packet\n");
+      continue;
+    }
+
+    const uint ack   = read_u32(packet + 0);
+    const uint start = read_u32(packet + 4);
+    const uint count = packet[8];
+    const u8*  input = packet + PACKET_HEADER;
+
+    if (ack > this->local_acked && ack <= this->frame)
+      this->local_acked = ack;
+
+    // Inputs are only taken in order. Anything before remote_frame is a
+    // duplicate, and anything after it means some packets are missing (in
+    // which case the peer will just send those inputs again).
+    if (start > this->remote_frame || start + count <= this->remote_frame)
+      continue;
+
+    for (uint i = this->remote_frame - start; i < count; i++) {
+      const uint frame = this->remote_frame++;
+      this->remote_input[frame % INPUT_HISTORY] = input[i];
+
+      if (frame < this->frame
+        && this->remote_played[frame % INPUT_HISTORY] != input[i]
+        && frame < this->rollback_to)
+        this->rollback_to = frame;
+    }
+  }
+}
+
+void RollbackSession::send_packet() {
+  uint start = this->local_acked;
+  uint count = this->frame - start;
+  if (count > PACKET_MAX_INPUTS)
+    count = PACKET_MAX_INPUTS;
+
+  u8 packet [PACKET_HEADER + PACKET_MAX_INPUTS];
+  write_u32(packet + 0, this->remote_frame);
+  write_u32(packet + 4, start);
+  packet[8] = count;
+  for (uint i = 0; i < count; i++)
+    packet[PACKET_HEADER + i] = this->local_input[(start + i) % INPUT_HISTORY];
+
+  this->transport.send(packet, PACKET_HEADER + count);
+}
+
+void RollbackSession::poll() {
+  this->recv_packets();
+  if (this->rollback_to != NO_ROLLBACK)
+    this->rollback();
+  this->send_packet();
+}
+
+bool RollbackSession::advance(u8 input) {
+  this->recv_packets();
+  if (this->rollback_to != NO_ROLLBACK)
+    this->rollback();
+
+  // Don't run so far ahead of the peer that a misprediction could no longer be
+  // rolled back (or that unacknowledged inputs fall out of the history)
+  if (this->frame >= this->remote_frame + this->max_rollback ||
+      this->frame >= this->local_acked + INPUT_HISTORY) {
+    this->stats.stalls++;
+    this->send_packet();
+    return false;
+  }
+
+  this->local_input[this->frame % INPUT_HISTORY] = input;
+  this->run_frame(this->frame, true);
+  this->frame++;
+
+  this->send_packet();
+  return true;
+}
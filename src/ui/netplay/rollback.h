@@ -0,0 +1,118 @@
+#pragma once
+
+#include <vector>
+
+#include "common/serializable.h"
+#include "common/util.h"
+#include "nes/joy/controllers/standard.h"
+#include "nes/nes.h"
+
+#include "transport.h"
+
+// GGPO-style rollback netplay, for two players on standard controllers.
+//
+// Both peers run the same ROM from the same initial state. Every frame runs
+// immediately with the local input, and a prediction of the remote input (the
+// last input that was actually received). Once the real remote input for a
+// frame shows up, and it turns out the prediction was wrong, the NES is rolled
+// back to the flat savestate taken just before that frame, and re-simulated up
+// to the present (without rendering, or generating audio).
+//
+// Inputs are sent over an unreliable transport: every packet carries all of
+// the local inputs the peer hasn't acknowledged yet, so lost / reordered
+// packets sort themselves out.
+//
+// Audio is _not_ rolled back: frames are heard as they were first run (with
+// the predicted input), and re-simulated frames are silent.
+class RollbackSession final {
+public:
+  // Picking the rollback window (the max # of frames to run ahead of the
+  // remote peer's confirmed input): re-simulating that many frames (plus
+  // running the current one) has to fit within a single host frame! A
+  // re-simulated frame costs ~2.7ms, and a rendered one ~5.4ms, which only
+  // leaves room for 3 (~14ms, measured with anese_netplay_sim). In other words:
+  // with the default, peers with more than ~50ms of one-way latency will stall
+  // instead of dropping host frames. Faster hosts can afford a bigger window
+  // (each frame of it buys another ~16ms of latency), so time it first.
+  static constexpr uint DEFAULT_MAX_ROLLBACK = 3;
+
+private:
+  NES& nes;
+  JOY_Standard* joy [2];
+  NetplayTransport& transport;
+  uint local;  // player # of the local player (0 / 1)
+  uint remote; // player # of the remote player (!local)
+
+  uint max_rollback; // rollback window, in frames
+
+  // Flat savestates (NES + both joypads), taken right before running a frame.
+  // The state for frame f lives in slot f % max_rollback. The NES part of each
+  // slot is saved incrementally (see NES::save_state_incremental), as long as
+  // the window fits in the Layout's history.
+  Serializable::Layout* joy_layout [2];
+  uint nes_state_size;
+  uint state_size;
+  std::vector<std::vector<u8>> states;
+  std::vector<u32>             state_sync;
+
+  void save_state(uint frame);
+  void load_state(uint frame);
+
+  // Input history (indexed by frame % INPUT_HISTORY)
+  static constexpr uint INPUT_HISTORY = 128;
+  u8 local_input   [INPUT_HISTORY];
+  u8 remote_input  [INPUT_HISTORY]; // as received
+  u8 remote_played [INPUT_HISTORY]; // as used to run the frame (maybe predicted)
+
+  uint frame = 0;        // next frame to run
+  uint remote_frame = 0; // remote inputs for every frame before this are known
+  uint local_acked = 0;  // peer has every local input before this
+  static constexpr uint NO_ROLLBACK = ~0u;
+  uint rollback_to = NO_ROLLBACK; // earliest mispredicted frame
+
+  void run_frame(uint frame, bool render);
+  void rollback();
+
+  void recv_packets();
+  void send_packet();
+
+public:
+  ~RollbackSession();
+  // The NES should have both joypads attached, and be in the same state as
+  // the peer's NES (eg: freshly power-cycled). Both peers should use the same
+  // rollback window (see DEFAULT_MAX_ROLLBACK).
+  RollbackSession(
+    NES& nes,
+    JOY_Standard& joy_1, JOY_Standard& joy_2,
+    uint local_player,
+    NetplayTransport& transport,
+    uint max_rollback = DEFAULT_MAX_ROLLBACK
+  );
+
+  RollbackSession(const RollbackSession&) = delete;
+  RollbackSession& operator=(const RollbackSession&) = delete;
+
+  // Called once per host frame. Handles incoming inputs (rolling back if
+  // needed), and runs the next frame with the given local input (see
+  // JOY_Standard_Button). Returns false if too far ahead of the peer to run
+  // another frame, in which case the input is dropped (the host should just
+  // try again next frame).
+  bool advance(u8 input);
+
+  // Handles incoming inputs and (re)sends local ones, without running a frame
+  void poll();
+
+  uint current_frame() const { return this->frame; }
+  uint window() const { return this->max_rollback; }
+  // Every frame before this one has been run with the peer's actual input
+  uint confirmed_frame() const {
+    return this->remote_frame < this->frame ? this->remote_frame : this->frame;
+  }
+
+  struct {
+    uint rollbacks = 0;    // # of mispredictions
+    uint resimulated = 0;  // # of frames re-simulated
+    uint max_rollback = 0; // most frames re-simulated in one go
+    uint stalls = 0;       // # of times advance() couldn't run a frame
+  } stats;
+};
@@ -0,0 +1,215 @@
+// Netplay test harness
+// Runs two rollback sessions against each other over a LoopbackLink (with
+// synthetic latency / jitter / packet loss), feeding both sides scripted
+// inputs, and checks that both peers end up in exactly the same state as a
+// plain old NES that was fed the same inputs directly.
+// Also times worst-case rollbacks, to make sure they fit in a host frame.
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <clara.hpp>
+
+#include "nes/cartridge/cartridge.h"
+#include "nes/joy/controllers/standard.h"
+#include "nes/nes.h"
+#include "nes/params.h"
+#include "ui/SDL2/fs/load.h"
+
+#include "../loopback.h"
+#include "../rollback.h"
+
+using Clock = std::chrono::high_resolution_clock;
+
+static double ms_since(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Scripted input: every player mashes a new random-ish combination of buttons
+// every few frames (with the odd Start press, to actually get into the game)
+static u8 scripted_input(uint player, uint frame) {
+  u32 x = (frame / (7 + player * 5)) * 0x9E3779B1 ^ (player + 1) * 0x85EBCA6B;
+  x ^= x >> 15; x *= 0x2C1B3C6D; x ^= x >> 12;
+  u8 input = x & ~JOY_Standard_Button::Select;
+  if ((x >> 8) % 4) input &= ~JOY_Standard_Button::Start;
+  return input;
+}
+
+static void set_buttons(JOY_Standard& joy, u8 input) {
+  for (uint b = 0; b < 8; b++) {
+    const auto btn = JOY_Standard_Button::Type(1 << b);
+    joy.set_button(btn, nth_bit(input, b));
+  }
+}
+
+struct Peer {
+  NES* nes;
+  JOY_Standard joy [2] { { "P1" }, { "P2" } };
+  RollbackSession* session = nullptr;
+  double worst_ms = 0; // slowest host frame
+
+  Peer(NES* nes) : nes(nes) {
+    nes->attach_joy(0, &this->joy[0]);
+    nes->attach_joy(1, &this->joy[1]);
+  }
+  ~Peer() { delete this->session; delete this->nes; }
+};
+
+int main(int argc, char* argv[]) {
+  std::string rom;
+  uint frames = 1200;
+  LoopbackLink::Params link_params;
+  link_params.latency = 3;
+  link_params.jitter  = 2;
+  link_params.loss    = 5;
+  uint seed = 1;
+  uint window = 8;
+
+  bool show_help = false;
+  auto cli
+    = clara::Help(show_help)
+    | clara::Opt(frames, "frames")
+        ["--frames"]
+        ("# of frames to run (default: 1200)")
+    | clara::Opt(link_params.latency, "ticks")
+        ["--latency"]
+        ("one-way latency, in host frames (default: 3)")
+    | clara::Opt(link_params.jitter, "ticks")
+        ["--jitter"]
+        ("up to this many extra host frames of latency (default: 2)")
+    | clara::Opt(link_params.loss, "percent")
+        ["--loss"]
+        ("% of packets to drop (default: 5)")
+    | clara::Opt(seed, "seed")
+        ["--seed"]
+        ("loopback RNG seed (default: 1)")
+    | clara::Opt(window, "frames")
+        ["--window"]
+        ("rollback window, in frames (default: 8)")
+    | clara::Arg(rom, "rom")
+        ("an iNES rom");
+
+  auto result = cli.parse(clara::Args(argc, argv));
+  if (!result || rom.empty() || window == 0 || show_help) {
+    if (!result) fprintf(stderr, "Error: %s\n", result.errorMessage().c_str());
+    std::cerr << cli;
+    return 1;
+  }
+
+  /*----------  Setup  ----------*/
+
+  Cartridge cart (ANESE_fs::load::load_rom_file(rom.c_str()));
+  if (cart.status() != Cartridge::Status::CART_NO_ERROR) {
+    fprintf(stderr, "[Netplay] Could not load ROM\n");
+    return 1;
+  }
+
+  NES_Params params {};
+  params.apu_sample_rate = 44100;
+  params.speed = 100;
+  params.compact = false; // render frames, just like the real thing
+
+  NES* base = new NES (params);
+  base->loadCartridge(cart.get_mapper());
+  base->power_cycle();
+
+  Peer reference (base->clone());
+  Peer peer [2] { { base->clone() }, { base->clone() } };
+
+  LoopbackLink link (link_params, seed);
+  for (uint i = 0; i < 2; i++) {
+    peer[i].session = new RollbackSession (
+      *peer[i].nes, peer[i].joy[0], peer[i].joy[1], i, link.end(i), window
+    );
+  }
+
+  /*----------  Run  ----------*/
+
+  // keep going until both peers have run every frame with the actual inputs
+  uint ticks = 0;
+  while (true) {
+    bool done = true;
+    for (Peer& p : peer) {
+      RollbackSession& s = *p.session;
+      if (s.confirmed_frame() < frames) done = false;
+
+      const uint player = &p - peer;
+      const Clock::time_point start = Clock::now();
+      if (s.current_frame() < frames)
+        s.advance(scripted_input(player, s.current_frame()));
+      else
+        s.poll();
+      const double ms = ms_since(start);
+      if (ms > p.worst_ms) p.worst_ms = ms;
+    }
+    if (done) break;
+
+    link.tick();
+    if (++ticks > frames * 100) {
+      fprintf(stderr, "[Netplay] Peers never synced up!\n");
+      return 1;
+    }
+  }
+
+  for (uint f = 0; f < frames; f++) {
+    set_buttons(reference.joy[0], scripted_input(0, f));
+    set_buttons(reference.joy[1], scripted_input(1, f));
+    reference.nes->step_frame();
+  }
+
+  // Everyone should have ended up in the exact same spot
+  bool in_sync = true;
+  std::vector<u8> expected (reference.nes->state_size());
+  std::vector<u8> actual   (reference.nes->state_size());
+  reference.nes->save_state(expected.data());
+  for (Peer& p : peer) {
+    p.nes->save_state(actual.data());
+    if (actual != expected) in_sync = false;
+  }
+
+  /*----------  Results  ----------*/
+
+  printf("frames: %u, host frames: %u\n", frames, ticks);
+  printf("link: latency %u, jitter %u, loss %u%% (%u / %u packets dropped)\n",
+    link_params.latency, link_params.jitter, link_params.loss,
+    link.stats.dropped, link.stats.sent);
+
+  for (uint i = 0; i < 2; i++) {
+    const RollbackSession& s = *peer[i].session;
+    printf("P%u: %u rollbacks, %u frames re-simulated (max %u), %u stalls, "
+           "slowest host frame %.2fms\n",
+      i + 1, s.stats.rollbacks, s.stats.resimulated, s.stats.max_rollback,
+      s.stats.stalls, peer[i].worst_ms);
+  }
+
+  // Time a worst-case rollback: load a state, re-simulate a whole window of
+  // frames without rendering (or audio), then render the current frame
+  NES& nes = *reference.nes;
+  std::vector<u8> state (nes.state_size());
+  double rollback_worst = 0, rollback_total = 0;
+  const uint runs = 60;
+  for (uint i = 0; i < runs; i++) {
+    nes.save_state(state.data());
+    const Clock::time_point start = Clock::now();
+    nes.load_state(state.data());
+    for (uint f = 0; f < window; f++) {
+      nes.save_state(state.data());
+      nes.resim_frame();
+    }
+    nes.step_frame();
+    const double ms = ms_since(start);
+    rollback_total += ms;
+    if (ms > rollback_worst) rollback_worst = ms;
+  }
+  printf("%u frame rollback: %.2fms avg, %.2fms worst (%s a 16.6ms host frame)\n",
+    window, rollback_total / runs, rollback_worst,
+    rollback_worst < 1000.0 / 60 ? "fits in" : "DOESN'T fit in");
+
+  printf("%s\n", in_sync ? "in sync" : "DESYNCED!");
+
+  delete base;
+  return in_sync ? 0 : 1;
+}
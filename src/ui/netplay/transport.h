@@ -0,0 +1,19 @@
+#pragma once
+
+#include "common/util.h"
+
+// Unreliable, unordered datagram transport between two netplay peers (i.e: the
+// same guarantees as UDP). Packets may be dropped, duplicated, or reordered,
+// but are never truncated or corrupted.
+class NetplayTransport {
+public:
+  virtual ~NetplayTransport() = default;
+
+  // Sends a single packet (len <= MAX_PACKET)
+  virtual void send(const u8* data, uint len) = 0;
+  // Pops a single received packet into data (which must hold MAX_PACKET
+  // bytes). Never blocks. Returns the packet's length, or 0 if there are none.
+  virtual uint recv(u8* data) = 0;
+
+  static constexpr uint MAX_PACKET = 512;
+};
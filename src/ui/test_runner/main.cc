@@ -0,0 +1,434 @@
+// Headless test ROM runner
+// Runs every ROM under a directory (roms/tests by default) in parallel, and
+// checks the results they report through the 0xDEB061 status protocol used by
+// blargg's test ROMs (see CPU_MMU::write):
+//   - $6000: status (0x80 = running, 0x81 = needs a reset, else result code)
+//   - $6004: null-terminated text output
+// ROMs that never write the signature are reported as skipped.
+//
+// Writes a summary to stdout, and (optionally) a JUnit XML / JSON report.
+// Given a previous JSON report as a baseline, only ROMs that used to pass (and
+// now don't) count as failures, which makes for a handy regression gate.
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <clara.hpp>
+
+#define CUTE_FILES_IMPLEMENTATION
+#include <cute_files.h>
+
+#include "nes/cartridge/cartridge.h"
+#include "nes/joy/controllers/standard.h"
+#include "nes/nes.h"
+#include "nes/params.h"
+#include "ui/SDL2/fs/load.h"
+
+using Clock = std::chrono::steady_clock;
+
+struct Test {
+  std::string path;
+  uint timeout = 0; // in frames
+
+  enum Result {
+    PASSED,
+    FAILED,    // reported a non-zero result code
+    TIMEOUT,   // still running when it ran out of frames
+    NO_STATUS, // never wrote the status signature
+    CRASHED,   // the CPU hit an unimplemented instruction
+    BAD_ROM,   // couldn't load the ROM
+  } result = BAD_ROM;
+
+  static const char* result_name(Result result) {
+    switch (result) {
+    case PASSED:    return "passed";
+    case FAILED:    return "failed";
+    case TIMEOUT:   return "timeout";
+    case NO_STATUS: return "no_status";
+    case CRASHED:   return "crashed";
+    case BAD_ROM:   return "bad_rom";
+    }
+    return "?";
+  }
+
+  uint code = 0;   // result code reported by the ROM
+  uint frames = 0; // frames emulated
+  double ms = 0;
+  std::string text;
+};
+
+struct Options {
+  uint timeout = 3600; // 1 emulated minute
+  uint probe = 60;     // give up on ROMs without a status after this long
+};
+
+/*----------------------------  Running a test  ----------------------------*/
+
+static void run_test(Test& test, const Options& opts) {
+  const auto start = Clock::now();
+
+  ROM_File* rom_file = ANESE_fs::load::load_rom_file(test.path.c_str());
+  if (!rom_file) {
+    test.result = Test::BAD_ROM;
+    return;
+  }
+
+  Cartridge cart (rom_file); // takes ownership of the ROM (and its data)
+  if (cart.status() != Cartridge::Status::CART_NO_ERROR) {
+    test.result = Test::BAD_ROM;
+    return;
+  }
+
+  NES_Params params {};
+  params.apu_sample_rate = 44100;
+  params.speed = 100;
+  params.compact = true; // nobody's watching
+
+  NES nes (params);
+  JOY_Standard joy [2] { { "P1" }, { "P2" } };
+  nes.attach_joy(0, &joy[0]);
+  nes.attach_joy(1, &joy[1]);
+  nes.loadCartridge(cart.get_mapper());
+  nes.power_cycle();
+
+  CPU_MMU::TestStatus& status = nes._cpu_mmu()._test_status;
+  status.echo = false;
+
+  // ROMs ask to be reset by setting their status to NEEDS_RESET, and expect
+  // the reset to come at least 100ms later
+  uint reset_at = 0;
+
+  test.result = Test::TIMEOUT;
+  for (test.frames = 1; test.frames <= test.timeout; test.frames++) {
+    nes.step_frame();
+
+    if (!nes.isRunning()) {
+      test.result = Test::CRASHED;
+      break;
+    }
+
+    if (!status.detected) {
+      if (test.frames >= opts.probe) {
+        test.result = Test::NO_STATUS;
+        break;
+      }
+      continue;
+    }
+
+    if (status.status < CPU_MMU::TestStatus::RUNNING) {
+      test.code = status.status;
+      test.result = test.code == 0 ? Test::PASSED : Test::FAILED;
+      break;
+    }
+
+    if (status.status == CPU_MMU::TestStatus::NEEDS_RESET) {
+      if (!reset_at) {
+        reset_at = test.frames + 6;
+      } else if (test.frames >= reset_at) {
+        reset_at = 0;
+        status.status = CPU_MMU::TestStatus::RUNNING;
+        nes.reset();
+      }
+    }
+  }
+  if (test.frames > test.timeout) test.frames = test.timeout;
+
+  test.text = status.text;
+  // trim trailing whitespace
+  while (!test.text.empty() && isspace((unsigned char)test.text.back()))
+    test.text.pop_back();
+
+  test.ms = std::chrono::duration<double, std::milli>(Clock::now() - start)
+    .count();
+}
+
+/*--------------------------------  Reports  -------------------------------*/
+
+static void write_escaped(FILE* f, const std::string& s, bool xml) {
+  for (char c : s) {
+    if (xml) {
+      switch (c) {
+      case '<':  fputs("&lt;",   f); break;
+      case '>':  fputs("&gt;",   f); break;
+      case '&':  fputs("&amp;",  f); break;
+      case '"':  fputs("&quot;", f); break;
+      default:
+        if ((unsigned char)c < 0x20 && c != '\n' && c != '\t') fputc('?', f);
+        else fputc(c, f);
+      }
+    } else {
+      switch (c) {
+      case '"':  fputs("\\\"", f); break;
+      case '\\': fputs("\\\\", f); break;
+      case '\n': fputs("\\n",  f); break;
+      case '\t': fputs("\\t",  f); break;
+      default:
+        if ((unsigned char)c < 0x20) fprintf(f, "\\u%04x", c);
+        else fputc(c, f);
+      }
+    }
+  }
+}
+
+static bool write_junit(const char* path, const std::vector<Test>& tests,
+                        uint failures, uint skipped, double ms) {
+  FILE* f = fopen(path, "w");
+  if (!f) return false;
+
+  fprintf(f, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+  fprintf(f, "<testsuite name=\"anese\" tests=\"%u\" failures=\"%u\" "
+             "skipped=\"%u\" time=\"%.3f\">\n",
+    uint(tests.size()), failures, skipped, ms / 1000);
+
+  for (const Test& test : tests) {
+    fprintf(f, "  <testcase name=\"");
+    write_escaped(f, test.path, true);
+    fprintf(f, "\" time=\"%.3f\">\n", test.ms / 1000);
+
+    switch (test.result) {
+    case Test::PASSED: break;
+    case Test::NO_STATUS:
+      fprintf(f, "    <skipped message=\"no status reported\"/>\n");
+      break;
+    default:
+      fprintf(f, "    <failure type=\"%s\" message=\"result %u after %u frames\">",
+        Test::result_name(test.result), test.code, test.frames);
+      write_escaped(f, test.text, true);
+      fprintf(f, "</failure>\n");
+      break;
+    }
+
+    fprintf(f, "  </testcase>\n");
+  }
+
+  fprintf(f, "</testsuite>\n");
+  fclose(f);
+  return true;
+}
+
+static bool write_json(const char* path, const std::vector<Test>& tests) {
+  FILE* f = fopen(path, "w");
+  if (!f) return false;
+
+  fprintf(f, "[\n");
+  for (size_t i = 0; i < tests.size(); i++) {
+    const Test& test = tests[i];
+    fprintf(f, "  {\"rom\":\"");
+    write_escaped(f, test.path, false);
+    fprintf(f, "\",\"result\":\"%s\",\"code\":%u,\"frames\":%u,\"ms\":%.1f,"
+               "\"text\":\"",
+      Test::result_name(test.result), test.code, test.frames, test.ms);
+    write_escaped(f, test.text, false);
+    fprintf(f, "\"}%s\n", i + 1 == tests.size() ? "" : ",");
+  }
+  fprintf(f, "]\n");
+
+  fclose(f);
+  return true;
+}
+
+/*---------------------------------  Setup  --------------------------------*/
+
+static void find_rom(cf_file_t* file, void* udata) {
+  if (!cf_match_ext(file, ".nes")) return;
+  Test test;
+  test.path = file->path;
+  ((std::vector<Test>*)udata)->push_back(test);
+}
+
+// Per-ROM timeouts: one `<frames> <path>` per line, where <path> matches the
+// end of a ROM's path (lines starting with '#' are comments)
+static bool load_timeouts(const char* path, std::vector<Test>& tests) {
+  FILE* f = fopen(path, "r");
+  if (!f) return false;
+
+  char line [512];
+  while (fgets(line, sizeof line, f)) {
+    uint frames;
+    char suffix [480];
+    if (line[0] == '#' || sscanf(line, "%u %479s", &frames, suffix) != 2)
+      continue;
+
+    const size_t len = strlen(suffix);
+    for (Test& test : tests) {
+      if (test.path.size() >= len &&
+          test.path.compare(test.path.size() - len, len, suffix) == 0)
+        test.timeout = frames;
+    }
+  }
+
+  fclose(f);
+  return true;
+}
+
+// Reads the results out of a JSON report (as written by write_json), and
+// checks for ROMs that passed in the baseline, but don't anymore.
+// Returns the # of regressions, or -1 if the baseline couldn't be read.
+static int check_baseline(const char* path, const std::vector<Test>& tests) {
+  FILE* f = fopen(path, "r");
+  if (!f) return -1;
+
+  int regressions = 0, fixes = 0;
+  char line [4096];
+  while (fgets(line, sizeof line, f)) {
+    char rom [1024], result [32];
+    if (sscanf(line, " {\"rom\":\"%1023[^\"]\",\"result\":\"%31[^\"]\"",
+               rom, result) != 2)
+      continue;
+
+    for (const Test& test : tests) {
+      if (test.path != rom) continue;
+      const bool passed_then = strcmp(result, "passed") == 0;
+      const bool passed_now  = test.result == Test::PASSED;
+      if (passed_then && !passed_now) {
+        printf("REGRESSED %s (now %s)\n", rom, Test::result_name(test.result));
+        regressions++;
+      }
+      if (!passed_then && passed_now) {
+        printf("FIXED     %s (was %s)\n", rom, result);
+        fixes++;
+      }
+    }
+  }
+  fclose(f);
+
+  printf("%d regressed, %d fixed (vs. %s)\n", regressions, fixes, path);
+  return regressions;
+}
+
+int main(int argc, char* argv[]) {
+  std::string dir = "roms/tests";
+  std::string junit_path;
+  std::string json_path;
+  std::string timeouts_path;
+  std::string baseline_path;
+  uint jobs = std::thread::hardware_concurrency();
+  Options opts;
+
+  bool show_help = false;
+  auto cli
+    = clara::Help(show_help)
+    | clara::Opt(jobs, "n")
+        ["-j"]["--jobs"]
+        ("# of ROMs to run at once (default: # of cores)")
+    | clara::Opt(opts.timeout, "frames")
+        ["--timeout"]
+        ("give up on ROMs that are still running after this many \n"
+         "frames (default: 3600)")
+    | clara::Opt(opts.probe, "frames")
+        ["--probe"]
+        ("give up on ROMs that haven't reported a status after \n"
+         "this many frames (default: 60)")
+    | clara::Opt(timeouts_path, "path")
+        ["--timeouts"]
+        ("per-ROM timeouts (lines of `<frames> <path suffix>`)")
+    | clara::Opt(junit_path, "path")
+        ["--junit"]
+        ("write a JUnit XML report")
+    | clara::Opt(json_path, "path")
+        ["--json"]
+        ("write a JSON report")
+    | clara::Opt(baseline_path, "path")
+        ["--baseline"]
+        ("only fail on ROMs that passed in this (JSON) report")
+    | clara::Arg(dir, "dir")
+        ("directory to search for ROMs (default: roms/tests)");
+
+  auto result = cli.parse(clara::Args(argc, argv));
+  if (!result || show_help) {
+    if (!result) fprintf(stderr, "Error: %s\n", result.errorMessage().c_str());
+    std::cerr << cli;
+    return 1;
+  }
+
+  std::vector<Test> tests;
+  cf_traverse(dir.c_str(), find_rom, &tests);
+  if (tests.empty()) {
+    fprintf(stderr, "[Test] No ROMs found under '%s'\n", dir.c_str());
+    return 1;
+  }
+  std::sort(tests.begin(), tests.end(), [](const Test& a, const Test& b) {
+    return a.path < b.path;
+  });
+
+  for (Test& test : tests)
+    test.timeout = opts.timeout;
+  if (!timeouts_path.empty() && !load_timeouts(timeouts_path.c_str(), tests)) {
+    fprintf(stderr, "[Test] Could not open '%s'\n", timeouts_path.c_str());
+    return 1;
+  }
+
+  /*----------  Run  ----------*/
+
+  if (jobs == 0) jobs = 1;
+  fprintf(stderr, "[Test] Running %u ROMs (%u at a time)\n",
+    uint(tests.size()), jobs);
+
+  const auto start = Clock::now();
+
+  std::atomic<uint> next { 0 };
+  std::mutex print_mutex;
+  auto worker = [&]() {
+    for (uint i; (i = next++) < tests.size(); ) {
+      Test& test = tests[i];
+      run_test(test, opts);
+
+      std::lock_guard<std::mutex> lock (print_mutex);
+      printf("%-9s %s (%u frames, %.0fms)\n",
+        Test::result_name(test.result), test.path.c_str(),
+        test.frames, test.ms);
+      fflush(stdout);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (uint i = 0; i < jobs; i++)
+    threads.emplace_back(worker);
+  for (std::thread& thread : threads)
+    thread.join();
+
+  const double ms = std::chrono::duration<double, std::milli>(
+    Clock::now() - start
+  ).count();
+
+  /*----------  Report  ----------*/
+
+  uint count [Test::BAD_ROM + 1] = {};
+  for (const Test& test : tests)
+    count[test.result]++;
+
+  const uint skipped  = count[Test::NO_STATUS];
+  const uint failures = uint(tests.size()) - count[Test::PASSED] - skipped;
+
+  printf("\n%u passed, %u failed, %u timed out, %u crashed, %u bad ROMs, "
+         "%u without a status (%.1fs)\n",
+    count[Test::PASSED], count[Test::FAILED], count[Test::TIMEOUT],
+    count[Test::CRASHED], count[Test::BAD_ROM], skipped, ms / 1000);
+
+  if (!junit_path.empty() &&
+      !write_junit(junit_path.c_str(), tests, failures, skipped, ms))
+    fprintf(stderr, "[Test] Could not write '%s'\n", junit_path.c_str());
+  if (!json_path.empty() && !write_json(json_path.c_str(), tests))
+    fprintf(stderr, "[Test] Could not write '%s'\n", json_path.c_str());
+
+  if (!baseline_path.empty()) {
+    printf("\n");
+    const int regressions = check_baseline(baseline_path.c_str(), tests);
+    if (regressions < 0) {
+      fprintf(stderr, "[Test] Could not open '%s'\n", baseline_path.c_str());
+      return 1;
+    }
+    return regressions ? 1 : 0;
+  }
+
+  return failures ? 1 : 0;
+}